@@ -0,0 +1,244 @@
+#ifndef AGGREGATING_CBUFF_H
+#define AGGREGATING_CBUFF_H
+
+#include "cbuffer.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <utility>
+/**
+@file aggregating_cbuffer.h
+@brief Dichiarazione della classe aggregating_cbuffer
+**/
+
+/**
+Somma compensata di Neumaier: l'errore di arrotondamento di ogni addizione
+viene accumulato a parte e aggiunto al risultato. Togliere un valore
+equivale ad aggiungerne l'opposto.
+**/
+class compensated_sum {
+public:
+  compensated_sum() : _sum(0.0), _comp(0.0) {
+  }
+
+  void add(double x) {
+    double t = _sum + x;
+    if(std::fabs(_sum) >= std::fabs(x))
+      _comp += (_sum - t) + x;
+    else
+      _comp += (x - t) + _sum;
+    _sum = t;
+  }
+
+  double value() const {
+    return _sum + _comp;
+  }
+
+  void reset() {
+    _sum = 0.0;
+    _comp = 0.0;
+  }
+
+private:
+  double _sum; ///< Somma ingenua
+  double _comp; ///< Errori di arrotondamento accumulati
+};
+
+/**
+Finestra scorrevole su cbuffer con statistiche mantenute in modo incrementale:
+somma, media, varianza, minimo e massimo costano O(1) in lettura e O(1)
+ammortizzato a ogni enqueue, sovrascrittura del più vecchio e pop.
+Minimo e massimo usano due deque monotone di coppie (numero di sequenza,
+valore); somma e varianza usano somme compensate dei valori traslati del
+primo elemento della finestra (così lo scarto quadratico non soffre di
+cancellazione quando i valori sono grandi e poco dispersi).
+L'accesso agli elementi è in sola lettura, altrimenti le statistiche
+non sarebbero più coerenti con il contenuto.
+@tparam T tipo aritmetico degli elementi
+**/
+template <typename T, typename Storage = heap_storage<T> >
+class aggregating_cbuffer {
+public:
+  typedef unsigned int size_type;
+  typedef T value_type;
+  typedef cbuffer<T, Storage> buffer_type;
+
+  /**
+  @brief Costruttore
+  @param size dimensione della finestra
+  **/
+  explicit aggregating_cbuffer(size_type size) : _cb(size), _seq(0), _shift(0.0) {
+  }
+
+  size_type capacity() const {
+    return _cb.capacity();
+  }
+
+  size_type countelem() const {
+    return _cb.countelem();
+  }
+
+  bool isEmpty() const {
+    return _cb.isEmpty();
+  }
+
+  bool isFull() const {
+    return _cb.isFull();
+  }
+
+  /**
+  @brief Buffer sottostante in sola lettura (iteratori, segmenti, evaluate_mask...)
+  **/
+  const buffer_type &buffer() const {
+    return _cb;
+  }
+
+  const T &operator[](size_type index) const {
+    return _cb[index];
+  }
+
+  /**
+  @brief Accoda un valore; se la finestra è piena il più vecchio esce
+  @param value valore da accodare
+  @return true
+  **/
+  bool enqueue(const T &value) {
+    if(_cb.isFull())
+      evict();
+    _cb.enqueue(value);
+    admit(value);
+    return true;
+  }
+
+  /**
+  @brief Accoda n valori
+  @param src indirizzo del primo valore
+  @param n numero di valori
+  @return numero di valori accodati
+  **/
+  size_type enqueue_n(const T *src, size_type n) {
+    for(size_type i = 0; i < n; ++i)
+      enqueue(src[i]);
+    return n;
+  }
+
+  /**
+  @brief Toglie l'elemento più vecchio
+  **/
+  void pop() {
+    assert(!_cb.isEmpty());
+    evict();
+    _cb.pop();
+  }
+
+  void clear() {
+    _cb.clear();
+    reset();
+  }
+
+  /**
+  @brief Somma compensata degli elementi della finestra
+  **/
+  double sum() const {
+    return _sums.value() + _shift * _cb.countelem();
+  }
+
+  /**
+  @brief Media degli elementi della finestra
+  @pre la finestra non è vuota
+  **/
+  double mean() const {
+    assert(!_cb.isEmpty());
+    return _shift + _sums.value() / _cb.countelem();
+  }
+
+  /**
+  @brief Varianza della popolazione della finestra (divisa per countelem())
+  @pre la finestra non è vuota
+  **/
+  double variance() const {
+    assert(!_cb.isEmpty());
+    double n = _cb.countelem();
+    double s = _sums.value();
+    double v = (_squares.value() - s * s / n) / n;
+    return v > 0.0 ? v : 0.0;
+  }
+
+  double stddev() const {
+    return std::sqrt(variance());
+  }
+
+  /**
+  @brief Minimo della finestra
+  @pre la finestra non è vuota
+  **/
+  const T &min() const {
+    assert(!_cb.isEmpty());
+    return _min.front().second;
+  }
+
+  /**
+  @brief Massimo della finestra
+  @pre la finestra non è vuota
+  **/
+  const T &max() const {
+    assert(!_cb.isEmpty());
+    return _max.front().second;
+  }
+
+private:
+  typedef std::deque<std::pair<std::size_t, T> > monotonic_deque;
+
+  // Aggiorna le statistiche con il valore appena accodato
+  void admit(const T &value) {
+    if(_cb.countelem() == 1)
+      _shift = static_cast<double>(value);
+    double d = static_cast<double>(value) - _shift;
+    _sums.add(d);
+    _squares.add(d * d);
+    while(!_min.empty() && !(_min.back().second < value))
+      _min.pop_back();
+    _min.push_back(std::make_pair(_seq, value));
+    while(!_max.empty() && !(value < _max.back().second))
+      _max.pop_back();
+    _max.push_back(std::make_pair(_seq, value));
+    ++_seq;
+  }
+
+  // Toglie dalle statistiche l'elemento più vecchio (prima che esca da _cb)
+  void evict() {
+    if(_cb.countelem() == 1) {
+      reset();
+      return;
+    }
+    std::size_t oldest = _seq - _cb.countelem();
+    double d = static_cast<double>(_cb[0]) - _shift;
+    _sums.add(-d);
+    _squares.add(-d * d);
+    if(_min.front().first == oldest)
+      _min.pop_front();
+    if(_max.front().first == oldest)
+      _max.pop_front();
+  }
+
+  // Finestra vuota: si riparte da zero, senza errori residui
+  void reset() {
+    _sums.reset();
+    _squares.reset();
+    _min.clear();
+    _max.clear();
+    _shift = 0.0;
+  }
+
+  buffer_type _cb; ///< Elementi della finestra
+  std::size_t _seq; ///< Numero di sequenza del prossimo elemento accodato
+  double _shift; ///< Traslazione applicata ai valori (primo elemento dopo uno svuotamento)
+  compensated_sum _sums; ///< Somma di (x - _shift)
+  compensated_sum _squares; ///< Somma di (x - _shift)^2
+  monotonic_deque _min; ///< Candidati al minimo, valori strettamente crescenti
+  monotonic_deque _max; ///< Candidati al massimo, valori strettamente decrescenti
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "../cbuffer.h"
+#include "../cbuffer_alloc.h"
+#include "bench.h"
+
+#include <string>
+#include <vector>
+
+/**
+@file alloc_bench.cpp
+@brief Costo degli allocatori: creazione e distruzione di molti cbuffer della
+stessa capacità con std::allocator contro pool_allocator, e accesso casuale
+a un anello grande con std::allocator contro hugepage_allocator (anche
+legato al nodo NUMA del thread)
+**/
+
+static const unsigned long BUFFERS = 2000000;
+static const unsigned long READS = 20000000;
+
+// si creano lotti di 1000 buffer da 256 int, si scrive un elemento in
+// ciascuno e si distruggono tutti insieme
+template <typename B, typename A>
+void churn(const std::string &name, const A &alloc) {
+  const unsigned int batch = 1000, size = 256;
+  std::vector<B> live;
+  live.reserve(batch);
+  unsigned long rounds = BUFFERS / batch;
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r) {
+    for(unsigned int i = 0; i < batch; ++i) {
+      live.emplace_back(std::in_place, size, alloc);
+      live.back().enqueue(static_cast<int>(i));
+    }
+    live.clear();
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(live);
+  bench::report((name + " crea+distruggi (256)").c_str(), ns, rounds * batch);
+}
+
+// letture a indici pseudo-casuali su un anello pieno da 2^25 int (128 MB):
+// quasi ogni accesso è un TLB miss con pagine da 4 KB
+template <typename A>
+void random_read(const std::string &name, const A &alloc) {
+  const unsigned int size = 1u << 25;
+  cbuffer<int, pow2_storage<int, A> > cb(std::in_place, size, alloc);
+  for(unsigned int i = 0; i < size + size / 2; ++i)
+    cb.enqueue(static_cast<int>(i));
+  unsigned int x = 12345;
+  long sum = 0;
+  bench::timer t;
+  for(unsigned long i = 0; i < READS; ++i) {
+    x = x * 1664525u + 1013904223u;
+    sum += cb[x >> 7];
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(sum);
+  bench::report((name + " operator[] casuale").c_str(), ns, READS);
+}
+
+int main() {
+  churn<cbuffer<int> >("std::allocator", std::allocator<int>());
+  cbuffer_pool pool(256 * sizeof(int), 1024);
+  churn<cbuffer<int, heap_storage<int, pool_allocator<int> > > >("pool_allocator", pool_allocator<int>(pool));
+
+  random_read("std::allocator[2^25]", std::allocator<int>());
+  random_read("hugepage_allocator[2^25]", hugepage_allocator<int>());
+  random_read("hugepage_allocator nodo[2^25]", hugepage_allocator<int>(current_numa_node()));
+  return 0;
+}
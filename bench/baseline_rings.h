@@ -0,0 +1,162 @@
+#ifndef CBUFF_BASELINE_RINGS_H
+#define CBUFF_BASELINE_RINGS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+@file baseline_rings.h
+@brief Termini di paragone per la suite: buffer circolari costruiti con
+std::deque e std::vector, con la stessa interfaccia minima di cbuffer
+**/
+
+/**
+Buffer circolare su std::deque: quando è pieno toglie il più vecchio con
+pop_front prima di push_back
+**/
+template <typename T>
+class deque_ring {
+  std::deque<T> d;
+  unsigned int cap;
+
+public:
+  typedef typename std::deque<T>::const_iterator const_iterator;
+
+  explicit deque_ring(unsigned int size) : cap(size) {
+  }
+
+  bool enqueue(const T &value) {
+    if(d.size() == cap)
+      d.pop_front();
+    d.push_back(value);
+    return true;
+  }
+
+  bool pop() {
+    d.pop_front();
+    return true;
+  }
+
+  unsigned int countelem() const {
+    return static_cast<unsigned int>(d.size());
+  }
+
+  bool isEmpty() const {
+    return d.empty();
+  }
+
+  bool isFull() const {
+    return d.size() == cap;
+  }
+
+  const T &operator[](unsigned int i) const {
+    return d[i];
+  }
+
+  const_iterator begin() const {
+    return d.begin();
+  }
+
+  const_iterator end() const {
+    return d.end();
+  }
+
+  bool equals(const deque_ring &other) const {
+    return cap == other.cap && d == other.d;
+  }
+};
+
+/**
+Buffer circolare "fatto a mano" su std::vector: celle sempre costruite,
+indici testa e conteggio con l'operatore modulo
+**/
+template <typename T>
+class vector_ring {
+  std::vector<T> v;
+  unsigned int head, count;
+
+public:
+  explicit vector_ring(unsigned int size) : v(size), head(0), count(0) {
+  }
+
+  bool enqueue(const T &value) {
+    v[(head + count) % v.size()] = value;
+    if(count == v.size())
+      head = (head + 1) % v.size();
+    else
+      ++count;
+    return true;
+  }
+
+  bool pop() {
+    head = (head + 1) % v.size();
+    --count;
+    return true;
+  }
+
+  unsigned int countelem() const {
+    return count;
+  }
+
+  bool isEmpty() const {
+    return count == 0;
+  }
+
+  bool isFull() const {
+    return count == v.size();
+  }
+
+  const T &operator[](unsigned int i) const {
+    return v[(head + i) % v.size()];
+  }
+
+  // l'iterazione di riferimento passa per operator[]
+  template <typename F>
+  void for_each(F f) const {
+    for(unsigned int i = 0; i < count; ++i)
+      f((*this)[i]);
+  }
+
+  bool equals(const vector_ring &other) const {
+    if(v.size() != other.v.size() || count != other.count)
+      return false;
+    for(unsigned int i = 0; i < count; ++i)
+      if(!((*this)[i] == other[i]))
+        return false;
+    return true;
+  }
+};
+
+/**
+Qualsiasi buffer circolare della suite protetto da mutex, con l'interfaccia
+try_* di spsc_cbuffer (quando è pieno rifiuta invece di sovrascrivere)
+**/
+template <typename R, typename T>
+class locked_ring {
+  R r;
+  std::mutex m;
+
+public:
+  explicit locked_ring(unsigned int size) : r(size) {
+  }
+
+  bool try_enqueue(const T &value) {
+    std::lock_guard<std::mutex> lock(m);
+    if(r.isFull())
+      return false;
+    return r.enqueue(value);
+  }
+
+  bool try_dequeue(T &out) {
+    std::lock_guard<std::mutex> lock(m);
+    if(r.isEmpty())
+      return false;
+    out = r[0];
+    return r.pop();
+  }
+};
+
+#endif
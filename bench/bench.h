@@ -0,0 +1,62 @@
+#ifndef CBUFF_BENCH_H
+#define CBUFF_BENCH_H
+
+#include <chrono>
+#include <cstdio>
+
+/**
+@file bench.h
+@brief Strumenti minimi per i microbenchmark di cbuffer
+**/
+
+namespace bench {
+
+/**
+Impedisce al compilatore di eliminare il calcolo che produce v
+**/
+template <typename V>
+inline void do_not_optimize(const V &v) {
+  asm volatile("" : : "r"(&v) : "memory");
+}
+
+/**
+Cronometro basato su steady_clock
+**/
+class timer {
+  std::chrono::steady_clock::time_point start;
+
+public:
+  timer() : start(std::chrono::steady_clock::now()) {
+  }
+
+  void reset() {
+    start = std::chrono::steady_clock::now();
+  }
+
+  double elapsed_ns() const {
+    return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+  }
+};
+
+/**
+Stampa una riga di risultato nel formato "nome  ns/op"
+@param name nome del benchmark
+@param ns tempo totale in nanosecondi
+@param ops numero di operazioni eseguite
+**/
+inline void report(const char *name, double ns, unsigned long ops) {
+  std::printf("%-48s %10.3f ns/op\n", name, ns / ops);
+}
+
+/**
+Come report, con in più i byte allocati per operazione
+@param bytes byte allocati in totale durante la misura
+**/
+inline void report(const char *name, double ns, unsigned long ops, unsigned long bytes) {
+  std::printf("%-48s %10.3f ns/op %10.1f B/op\n", name, ns / ops, static_cast<double>(bytes) / ops);
+}
+
+} // namespace bench
+
+#endif
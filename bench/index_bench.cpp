@@ -0,0 +1,207 @@
+#include "../cbuffer.h"
+#include "../mmap_storage.h"
+#include "legacy_cbuffer.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+@file index_bench.cpp
+@brief Throughput di enqueue/pop/operator[] e dei predicati: vecchio motore degli indici
+contro first/nelem con heap_storage, pow2_storage, inline_storage e mmap_storage,
+e consumo a lotti con pop contro drain
+**/
+
+static const unsigned long OPS = 20000000;
+
+// enqueue a buffer pieno: ogni inserimento sovrascrive il più vecchio
+template <typename B>
+void steady_enqueue(const std::string &name, unsigned int size) {
+  B cb(size);
+  for(unsigned int i = 0; i < size; ++i)
+    cb.enqueue(static_cast<int>(i));
+  bench::timer t;
+  for(unsigned long i = 0; i < OPS; ++i)
+    cb.enqueue(static_cast<int>(i));
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(cb[0]);
+  bench::report((name + " enqueue (pieno)").c_str(), ns, OPS);
+}
+
+// riempimento fino a metà e svuotamento, gli indici fanno il giro dell'array
+template <typename B>
+void enqueue_pop(const std::string &name, unsigned int size) {
+  B cb(size);
+  unsigned int half = size / 2;
+  unsigned long rounds = OPS / (2 * half);
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r) {
+    for(unsigned int i = 0; i < half; ++i)
+      cb.enqueue(static_cast<int>(i));
+    for(unsigned int i = 0; i < half; ++i)
+      cb.pop();
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(cb);
+  bench::report((name + " enqueue+pop").c_str(), ns, rounds * 2 * half);
+}
+
+// lettura sequenziale con operator[] dopo aver spostato first a metà array
+template <typename B>
+void index_read(const std::string &name, unsigned int size) {
+  B cb(size);
+  for(unsigned int i = 0; i < size + size / 2; ++i)
+    cb.enqueue(static_cast<int>(i));
+  unsigned long rounds = OPS / size;
+  long sum = 0;
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r)
+    for(unsigned int i = 0; i < cb.countelem(); ++i)
+      sum += cb[i];
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(sum);
+  bench::report((name + " operator[]").c_str(), ns, rounds * size);
+}
+
+// stesso carico di enqueue_pop ma a pacchetti con enqueue_n/dequeue_n
+template <typename B>
+void bulk_enqueue_dequeue(const std::string &name, unsigned int size) {
+  B cb(size);
+  const unsigned int packet = 256;
+  int in[packet], out[packet];
+  for(unsigned int i = 0; i < packet; ++i)
+    in[i] = static_cast<int>(i);
+  unsigned long rounds = OPS / (2 * packet);
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r) {
+    cb.enqueue_n(in, packet);
+    cb.dequeue_n(out, packet);
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(out);
+  bench::report((name + " enqueue_n+dequeue_n (256)").c_str(), ns, rounds * 2 * packet);
+}
+
+// predicato su tutti gli elementi: ciclo con operator[], count_if con un
+// funtore qualsiasi (ramo scalare) e count_if con greater_than (kernel AVX2)
+static bool over_half(int x) {
+  return x > 500;
+}
+
+void predicate_count(const std::string &name, unsigned int size) {
+  cbuffer<int> cb(size);
+  for(unsigned int i = 0; i < size + size / 3; ++i)
+    cb.enqueue(static_cast<int>(i % 1000));
+  unsigned long rounds = OPS / size;
+  unsigned long sum = 0;
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r)
+    for(unsigned int i = 0; i < size; ++i)
+      sum += cb[i] > 500;
+  double ns = t.elapsed_ns();
+  bench::report((name + " predicato con operator[]").c_str(), ns, rounds * size);
+  t.reset();
+  for(unsigned long r = 0; r < rounds; ++r)
+    sum += count_if(cb, over_half);
+  ns = t.elapsed_ns();
+  bench::report((name + " count_if scalare").c_str(), ns, rounds * size);
+  t.reset();
+  for(unsigned long r = 0; r < rounds; ++r)
+    sum += count_if(cb, greater_than(500));
+  ns = t.elapsed_ns();
+  bench::report((name + " count_if greater_than").c_str(), ns, rounds * size);
+  bench::do_not_optimize(sum);
+}
+
+// consumatore a lotti (riempiti con enqueue_n): lettura con operator[] e pop per elemento contro
+// drain, che passa i tratti contigui e aggiorna gli indici una volta sola
+void batch_consume(const std::string &name, unsigned int size) {
+  cbuffer<int> cb(size);
+  unsigned int batch = size - size / 4;
+  unsigned long rounds = OPS / batch;
+  std::vector<int> in(batch);
+  for(unsigned int i = 0; i < batch; ++i)
+    in[i] = static_cast<int>(i);
+  long sum = 0;
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r) {
+    cb.enqueue_n(&in[0], batch);
+    while(!cb.isEmpty()) {
+      sum += cb[0];
+      cb.pop();
+    }
+  }
+  double ns = t.elapsed_ns();
+  bench::report((name + " operator[]+pop").c_str(), ns, rounds * batch);
+  t.reset();
+  for(unsigned long r = 0; r < rounds; ++r) {
+    cb.enqueue_n(&in[0], batch);
+    cb.drain([&sum](int *p, unsigned int n) {
+      for(unsigned int i = 0; i < n; ++i)
+        sum += p[i];
+    });
+  }
+  ns = t.elapsed_ns();
+  bench::report((name + " drain").c_str(), ns, rounds * batch);
+  bench::do_not_optimize(sum);
+}
+
+// stampa di 100k elementi su file: riga per riga con endl contro operator<<,
+// e checkpoint binario con serialize
+void dump(const std::string &name) {
+  const unsigned int size = 100000;
+  cbuffer<int> cb(size);
+  for(unsigned int i = 0; i < size + size / 3; ++i)
+    cb.enqueue(static_cast<int>(i));
+  const char *path_a = "/tmp/cbuffer_bench_endl.txt", *path_b = "/tmp/cbuffer_bench_dump.txt";
+  std::ofstream a(path_a), b(path_b);
+  std::ostringstream c;
+  bench::timer t;
+  for(cbuffer<int>::const_iterator i = cb.begin(); i != cb.end(); ++i)
+    a << *i << std::endl;
+  double ns = t.elapsed_ns();
+  bench::report((name + " stampa con endl").c_str(), ns, size);
+  t.reset();
+  b << cb;
+  ns = t.elapsed_ns();
+  bench::report((name + " operator<<").c_str(), ns, size);
+  t.reset();
+  serialize(c, cb);
+  ns = t.elapsed_ns();
+  bench::report((name + " serialize").c_str(), ns, size);
+  bench::do_not_optimize(c.tellp());
+  std::remove(path_a);
+  std::remove(path_b);
+}
+
+template <typename B>
+void run_all(const std::string &name, unsigned int size) {
+  steady_enqueue<B>(name, size);
+  enqueue_pop<B>(name, size);
+  index_read<B>(name, size);
+}
+
+int main() {
+  run_all<legacy_cbuffer<int> >("legacy[1000]", 1000);
+  run_all<cbuffer<int> >("heap_storage[1000]", 1000);
+  run_all<cbuffer<int, pow2_storage<int> > >("pow2_storage[1000]", 1000);
+  run_all<fixed_cbuffer<int, 1000> >("inline_storage[1000]", 1000);
+  run_all<cbuffer<int, mmap_storage<int> > >("mmap_storage[1000]", 1000);
+  run_all<cbuffer<int, heap_storage<int>, counting_stats> >("heap+counting_stats[1000]", 1000);
+
+  run_all<legacy_cbuffer<int> >("legacy[1024]", 1024);
+  run_all<cbuffer<int> >("heap_storage[1024]", 1024);
+  run_all<cbuffer<int, pow2_storage<int> > >("pow2_storage[1024]", 1024);
+  run_all<fixed_cbuffer<int, 1024> >("inline_storage[1024]", 1024);
+
+  bulk_enqueue_dequeue<cbuffer<int> >("heap_storage[1000]", 1000);
+  bulk_enqueue_dequeue<cbuffer<int, pow2_storage<int> > >("pow2_storage[1024]", 1024);
+  predicate_count("heap_storage[4096]", 4096);
+  batch_consume("heap_storage[1000]", 1000);
+  dump("heap_storage[100000]");
+  return 0;
+}
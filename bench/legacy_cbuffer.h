@@ -0,0 +1,91 @@
+#ifndef CBUFF_LEGACY_H
+#define CBUFF_LEGACY_H
+
+#include <cassert>
+
+/**
+@file legacy_cbuffer.h
+@brief Motore degli indici di cbuffer precedente a first/nelem
+
+Copia ridotta (enqueue, pop, operator[]) della vecchia implementazione a
+first/last/freespace, tenuta solo come termine di paragone nei benchmark.
+Unica differenza: enqueue e pop ritornano esplicitamente un valore.
+**/
+template <typename T>
+class legacy_cbuffer {
+public:
+  typedef unsigned int size_type;
+
+  explicit legacy_cbuffer(size_type size)
+  : _buffer(new T[size]), _size(size), first(0), last(0), freespace(size) {
+  }
+
+  ~legacy_cbuffer() {
+    delete[] _buffer;
+  }
+
+  bool isEmpty() const {
+    return freespace == _size;
+  }
+
+  size_type countelem() const {
+    return _size - freespace;
+  }
+
+  bool enqueue(const T &value) {
+    assert(_size != 0);
+    if(first == last + 1){
+      _buffer[first] = value;
+      first = (first + 1) % (_size - 1);
+      last = (last + 1);
+    }
+    else if(((last >= first && last < (_size-1)) && !isEmpty())|| (first > last)){
+      last = last + 1;
+      _buffer[last] = value;
+      freespace--;
+    }
+    else if((last == (_size - 1)) && first == 0){
+      last = 0;
+      first = 1;
+      _buffer[last] = value;
+    }
+    else if(last == (_size - 1))
+    {
+      last = 0;
+      _buffer[last] = value;
+      freespace--;
+    }
+    else{
+      _buffer[last] = value;
+      freespace--;
+    }
+    return true;
+  }
+
+  bool pop() {
+    assert(!isEmpty());
+    if(first == last)
+      freespace = _size;
+    else{
+      first = (first + 1)%_size;
+      freespace++;
+    }
+    return true;
+  }
+
+  T &operator[](size_type index) {
+    return _buffer[((first+index)%_size)];
+  }
+
+private:
+  legacy_cbuffer(const legacy_cbuffer &);
+  legacy_cbuffer &operator=(const legacy_cbuffer &);
+
+  T *_buffer;
+  size_type _size;
+  size_type first;
+  size_type last;
+  size_type freespace;
+};
+
+#endif
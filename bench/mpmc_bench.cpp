@@ -0,0 +1,57 @@
+#include "../mpmc_cbuffer.h"
+#include "bench.h"
+#include "mutex_cbuffer.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+@file mpmc_bench.cpp
+@brief Scalabilità di mpmc_cbuffer contro cbuffer protetto da mutex
+con 1..N produttori e altrettanti consumatori
+**/
+
+static const unsigned long OPS = 1000000;
+
+template <typename Q>
+void scaling(const std::string &name, unsigned int threads) {
+  Q q(1024);
+  unsigned long per_thread = OPS / threads;
+  std::vector<std::thread> pool;
+  std::vector<long> sums(threads, 0);
+  bench::timer t;
+  for(unsigned int p = 0; p < threads; ++p)
+    pool.push_back(std::thread([&q, per_thread]() {
+      for(unsigned long i = 0; i < per_thread; ++i)
+        while(!q.try_enqueue(static_cast<int>(i)))
+          std::this_thread::yield();
+    }));
+  for(unsigned int c = 0; c < threads; ++c)
+    pool.push_back(std::thread([&q, &sums, c, per_thread]() {
+      int v;
+      long sum = 0;
+      for(unsigned long i = 0; i < per_thread; ++i) {
+        while(!q.try_dequeue(v))
+          std::this_thread::yield();
+        sum += v;
+      }
+      sums[c] = sum;
+    }));
+  for(unsigned int i = 0; i < pool.size(); ++i)
+    pool[i].join();
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(sums);
+  bench::report((name + " " + std::to_string(threads) + "P/" + std::to_string(threads) + "C").c_str(),
+                ns, per_thread * threads);
+}
+
+int main() {
+  unsigned int max_threads = std::max(4u, std::thread::hardware_concurrency());
+  for(unsigned int n = 1; n <= max_threads; n *= 2) {
+    scaling<mpmc_cbuffer<int> >("mpmc_cbuffer", n);
+    scaling<mutex_cbuffer<int> >("mutex+cbuffer", n);
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef CBUFF_MUTEX_BENCH_H
+#define CBUFF_MUTEX_BENCH_H
+
+#include "../cbuffer.h"
+
+#include <algorithm>
+#include <mutex>
+
+/**
+@file mutex_cbuffer.h
+@brief Termine di paragone per le varianti concorrenti: cbuffer protetto da mutex
+**/
+
+/**
+cbuffer protetto da mutex con la stessa interfaccia try_* di spsc_cbuffer
+(quando è pieno rifiuta invece di sovrascrivere)
+**/
+template <typename T>
+class mutex_cbuffer {
+  cbuffer<T> cb;
+  std::mutex m;
+
+public:
+  explicit mutex_cbuffer(unsigned int size) : cb(size) {
+  }
+
+  bool try_enqueue(const T &value) {
+    std::lock_guard<std::mutex> lock(m);
+    if(cb.isFull())
+      return false;
+    return cb.enqueue(value);
+  }
+
+  bool try_dequeue(T &out) {
+    std::lock_guard<std::mutex> lock(m);
+    if(cb.isEmpty())
+      return false;
+    out = cb[0];
+    return cb.pop();
+  }
+
+  unsigned int try_enqueue_n(const T *src, unsigned int n) {
+    std::lock_guard<std::mutex> lock(m);
+    n = std::min(n, cb.capacity() - cb.countelem());
+    return cb.enqueue_n(src, n);
+  }
+
+  unsigned int try_dequeue_n(T *out, unsigned int n) {
+    std::lock_guard<std::mutex> lock(m);
+    return cb.dequeue_n(out, n);
+  }
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "../sharded_cbuffer.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+@file shard_bench.cpp
+@brief Registrazione di eventi di traccia da 1..N thread: un cbuffer unico
+protetto da mutex contro sharded_cbuffer, con un lettore che raccoglie
+gli eventi in ordine di marca mentre gli scrittori lavorano. Gli anelli
+contengono tutti gli eventi, così nessuno viene scartato o sovrascritto
+e si misura solo il costo della registrazione.
+**/
+
+static const unsigned long EVENTS = 2000000;
+
+struct event {
+  unsigned int thread;
+  unsigned int id;
+  unsigned long payload;
+};
+
+// cbuffer unico: gli scrittori marcano e accodano sotto lock (sovrascrivendo
+// il più vecchio), il lettore copia e svuota sotto lo stesso lock
+class locked_trace {
+public:
+  explicit locked_trace(unsigned int size) : _cb(size) {
+  }
+
+  void record(const event &e) {
+    std::lock_guard<std::mutex> lock(_m);
+    _cb.enqueue(stamped<event>(steady_stamp::now(), e));
+  }
+
+  unsigned int collect(std::vector<stamped<event> > &out) {
+    std::lock_guard<std::mutex> lock(_m);
+    unsigned int n = _cb.countelem();
+    out.resize(n);
+    return n == 0 ? 0 : _cb.dequeue_n(&out[0], n);
+  }
+
+private:
+  cbuffer<stamped<event> > _cb;
+  std::mutex _m;
+};
+
+template <typename W>
+void run(const std::string &name, unsigned int threads, W write, std::atomic<bool> &done) {
+  unsigned long per_thread = EVENTS / threads;
+  std::vector<std::thread> pool;
+  bench::timer t;
+  for(unsigned int p = 0; p < threads; ++p)
+    pool.push_back(std::thread([&write, p, per_thread]() {
+      write(p, per_thread);
+    }));
+  for(unsigned int i = 0; i < pool.size(); ++i)
+    pool[i].join();
+  double ns = t.elapsed_ns();
+  done = true;
+  bench::report((name + " " + std::to_string(threads) + " scrittori").c_str(), ns, per_thread * threads);
+}
+
+void locked(unsigned int threads) {
+  locked_trace trace(EVENTS);
+  std::atomic<bool> done(false);
+  std::thread reader([&trace, &done]() {
+    std::vector<stamped<event> > out;
+    unsigned long n = 0;
+    while(!done) {
+      n += trace.collect(out);
+      std::this_thread::yield();
+    }
+    bench::do_not_optimize(n);
+  });
+  run("mutex+cbuffer", threads, [&trace](unsigned int p, unsigned long count) {
+    for(unsigned long i = 0; i < count; ++i)
+      trace.record(event{p, static_cast<unsigned int>(i), i});
+  }, done);
+  reader.join();
+}
+
+void sharded(unsigned int threads) {
+  sharded_cbuffer<event> trace(threads, EVENTS / threads);
+  std::atomic<bool> done(false);
+  std::thread reader([&trace, &done]() {
+    std::vector<stamped<event> > out;
+    unsigned long n = 0;
+    while(!done) {
+      out.clear();
+      n += trace.drain_ordered(out);
+      std::this_thread::yield();
+    }
+    bench::do_not_optimize(n);
+  });
+  run("sharded_cbuffer", threads, [&trace](unsigned int p, unsigned long count) {
+    sharded_cbuffer<event>::writer w = trace.attach();
+    for(unsigned long i = 0; i < count; ++i)
+      w.record(event{p, static_cast<unsigned int>(i), i});
+  }, done);
+  reader.join();
+}
+
+int main() {
+  unsigned int max_threads = std::max(4u, std::thread::hardware_concurrency());
+  for(unsigned int n = 1; n <= max_threads; n *= 2) {
+    locked(n);
+    sharded(n);
+  }
+  return 0;
+}
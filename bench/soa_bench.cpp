@@ -0,0 +1,109 @@
+#include "../cbuffer_soa.h"
+#include "bench.h"
+
+#include <string>
+
+/**
+@file soa_bench.cpp
+@brief Record di mercato da 10 campi: cbuffer di struct contro cbuffer_soa
+per accodamento, filtro su una colonna e somma di una colonna
+**/
+
+static const unsigned long OPS = 20000000;
+static const unsigned int SIZE = 1u << 16;
+
+struct quote {
+  long timestamp;
+  double price;
+  double bid;
+  double ask;
+  double bid_size;
+  double ask_size;
+  int volume;
+  int venue;
+  int flags;
+  int symbol;
+};
+
+typedef cbuffer_soa<long, double, double, double, double, double, int, int, int, int> quote_soa;
+
+static quote make_quote(unsigned long i) {
+  double p = 100.0 + static_cast<double>((i * 2654435761u) % 1000) * 0.01;
+  quote q = {static_cast<long>(i), p, p - 0.01, p + 0.01, 10.0, 12.0, static_cast<int>(i % 500), 1, 0, 42};
+  return q;
+}
+
+static void fill(cbuffer<quote> &cb, unsigned long n) {
+  for(unsigned long i = 0; i < n; ++i)
+    cb.enqueue(make_quote(i));
+}
+
+static void fill(quote_soa &cb, unsigned long n) {
+  for(unsigned long i = 0; i < n; ++i) {
+    quote q = make_quote(i);
+    cb.emplace(q.timestamp, q.price, q.bid, q.ask, q.bid_size, q.ask_size, q.volume, q.venue, q.flags, q.symbol);
+  }
+}
+
+template <typename B>
+void enqueue(const std::string &name) {
+  B cb(SIZE);
+  bench::timer t;
+  fill(cb, OPS / 4);
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(cb);
+  bench::report((name + " enqueue").c_str(), ns, OPS / 4);
+}
+
+// quante quotazioni hanno prezzo sopra soglia, e volume totale
+void scan_aos() {
+  cbuffer<quote> cb(SIZE);
+  fill(cb, SIZE + SIZE / 3);
+  unsigned long rounds = OPS / SIZE, hits = 0;
+  long volume = 0;
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r)
+    hits += count_if(cb, [](const quote &q) { return q.price > 105.0; });
+  double ns = t.elapsed_ns();
+  bench::report("cbuffer<quote> count_if(price > x)", ns, rounds * SIZE);
+  t.reset();
+  for(unsigned long r = 0; r < rounds; ++r)
+    cb.for_each_segment([&volume](const quote *p, unsigned int n) {
+      for(unsigned int i = 0; i < n; ++i)
+        volume += p[i].volume;
+    });
+  ns = t.elapsed_ns();
+  bench::report("cbuffer<quote> somma volume", ns, rounds * SIZE);
+  bench::do_not_optimize(hits);
+  bench::do_not_optimize(volume);
+}
+
+void scan_soa() {
+  quote_soa cb(SIZE);
+  fill(cb, SIZE + SIZE / 3);
+  unsigned long rounds = OPS / SIZE, hits = 0;
+  long volume = 0;
+  bench::timer t;
+  for(unsigned long r = 0; r < rounds; ++r)
+    hits += count_if(cb.column<1>(), greater_than(105.0));
+  double ns = t.elapsed_ns();
+  bench::report("cbuffer_soa count_if(price > x)", ns, rounds * SIZE);
+  t.reset();
+  for(unsigned long r = 0; r < rounds; ++r)
+    cb.column<6>().for_each_segment([&volume](const int *p, unsigned int n) {
+      for(unsigned int i = 0; i < n; ++i)
+        volume += p[i];
+    });
+  ns = t.elapsed_ns();
+  bench::report("cbuffer_soa somma volume", ns, rounds * SIZE);
+  bench::do_not_optimize(hits);
+  bench::do_not_optimize(volume);
+}
+
+int main() {
+  enqueue<cbuffer<quote> >("cbuffer<quote>");
+  enqueue<quote_soa>("cbuffer_soa");
+  scan_aos();
+  scan_soa();
+  return 0;
+}
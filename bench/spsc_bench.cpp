@@ -0,0 +1,116 @@
+#include "../spsc_cbuffer.h"
+#include "bench.h"
+#include "mutex_cbuffer.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+@file spsc_bench.cpp
+@brief Passaggio di dati tra due thread: spsc_cbuffer contro cbuffer protetto
+da mutex (throughput e latenza di andata e ritorno)
+**/
+
+static const unsigned long OPS = 2000000;
+static const unsigned long PINGS = 100000;
+
+// attesa attiva che cede il processore (la macchina può avere un solo core)
+inline void relax() {
+  std::this_thread::yield();
+}
+
+template <typename Q>
+void throughput(const std::string &name) {
+  Q q(1024);
+  bench::timer t;
+  std::thread producer([&q]() {
+    for(unsigned long i = 0; i < OPS; ++i)
+      while(!q.try_enqueue(static_cast<int>(i)))
+        relax();
+  });
+  long sum = 0;
+  int v;
+  for(unsigned long i = 0; i < OPS; ++i) {
+    while(!q.try_dequeue(v))
+      relax();
+    sum += v;
+  }
+  producer.join();
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(sum);
+  bench::report((name + " throughput").c_str(), ns, OPS);
+}
+
+template <typename Q>
+void bulk_throughput(const std::string &name) {
+  Q q(1024);
+  const unsigned int packet = 64;
+  bench::timer t;
+  std::thread producer([&q]() {
+    int in[packet];
+    for(unsigned int i = 0; i < packet; ++i)
+      in[i] = static_cast<int>(i);
+    for(unsigned long sent = 0; sent < OPS; ) {
+      unsigned int n = q.try_enqueue_n(in, packet);
+      if(n == 0)
+        relax();
+      sent += n;
+    }
+  });
+  int out[packet];
+  long sum = 0;
+  for(unsigned long got = 0; got < OPS; ) {
+    unsigned int n = q.try_dequeue_n(out, packet);
+    if(n == 0)
+      relax();
+    for(unsigned int i = 0; i < n; ++i)
+      sum += out[i];
+    got += n;
+  }
+  producer.join();
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(sum);
+  bench::report((name + " throughput a pacchetti (64)").c_str(), ns, OPS);
+}
+
+// andata e ritorno su due code: il secondo thread rimanda indietro ogni valore
+template <typename Q>
+void latency(const std::string &name) {
+  Q ping(64), pong(64);
+  std::thread echo([&ping, &pong]() {
+    int v;
+    for(unsigned long i = 0; i < PINGS; ++i) {
+      while(!ping.try_dequeue(v))
+        relax();
+      while(!pong.try_enqueue(v))
+        relax();
+    }
+  });
+  std::vector<double> samples;
+  samples.reserve(PINGS);
+  int v;
+  for(unsigned long i = 0; i < PINGS; ++i) {
+    bench::timer t;
+    while(!ping.try_enqueue(static_cast<int>(i)))
+      relax();
+    while(!pong.try_dequeue(v))
+      relax();
+    samples.push_back(t.elapsed_ns());
+  }
+  echo.join();
+  std::sort(samples.begin(), samples.end());
+  std::printf("%-48s p50 %10.0f ns   p99 %10.0f ns\n", (name + " andata e ritorno").c_str(),
+              samples[samples.size() / 2], samples[samples.size() * 99 / 100]);
+}
+
+int main() {
+  throughput<spsc_cbuffer<int> >("spsc_cbuffer");
+  throughput<mutex_cbuffer<int> >("mutex+cbuffer");
+  bulk_throughput<spsc_cbuffer<int> >("spsc_cbuffer");
+  bulk_throughput<mutex_cbuffer<int> >("mutex+cbuffer");
+  latency<spsc_cbuffer<int> >("spsc_cbuffer");
+  latency<mutex_cbuffer<int> >("mutex+cbuffer");
+  return 0;
+}
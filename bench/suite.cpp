@@ -0,0 +1,273 @@
+#include "../cbuffer.h"
+#include "../spsc_cbuffer.h"
+#include "baseline_rings.h"
+#include "bench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+/**
+@file suite.cpp
+@brief Suite di benchmark: cbuffer contro deque_ring (std::deque) e
+vector_ring (std::vector) su int, un POD di 64 byte e std::string.
+Per ogni carico stampa ns/op e byte allocati per operazione.
+**/
+
+// Contatore dei byte allocati: sostituisce gli operator new globali
+static std::atomic<unsigned long> allocated(0);
+
+void *operator new(std::size_t n) {
+  allocated.fetch_add(n, std::memory_order_relaxed);
+  if(void *p = std::malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t n, std::align_val_t a) {
+  allocated.fetch_add(n, std::memory_order_relaxed);
+  std::size_t al = static_cast<std::size_t>(a);
+  if(void *p = std::aligned_alloc(al, (n + al - 1) / al * al))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+static const unsigned int SIZE = 1024;
+static const unsigned long OPS = 2000000;
+static const unsigned long HANDOFF = 500000;
+
+// POD di 64 byte (una linea di cache)
+struct pod64 {
+  long v[8];
+
+  bool operator==(const pod64 &o) const {
+    for(unsigned int i = 0; i < 8; ++i)
+      if(v[i] != o.v[i])
+        return false;
+    return true;
+  }
+
+  bool operator!=(const pod64 &o) const {
+    return !(*this == o);
+  }
+};
+
+template <typename T> T make_value(unsigned long i);
+
+template <> int make_value<int>(unsigned long i) {
+  return static_cast<int>(i);
+}
+
+template <> pod64 make_value<pod64>(unsigned long i) {
+  pod64 p;
+  for(unsigned int k = 0; k < 8; ++k)
+    p.v[k] = static_cast<long>(i + k);
+  return p;
+}
+
+// stringhe di 32 caratteri: oltre la small string optimization, allocano
+template <> std::string make_value<std::string>(unsigned long i) {
+  std::string s(32, 'x');
+  s[i % 32] = static_cast<char>('a' + i % 26);
+  return s;
+}
+
+inline long digest(int v) {
+  return v;
+}
+
+inline long digest(const pod64 &p) {
+  return p.v[0];
+}
+
+inline long digest(const std::string &s) {
+  return static_cast<long>(s.size()) + s[0];
+}
+
+// Visita in ordine di tutti gli elementi (iteratori, o operator[] per vector_ring)
+template <typename R, typename F>
+void visit(const R &r, F f) {
+  for(typename R::const_iterator i = r.begin(), ie = r.end(); i != ie; ++i)
+    f(*i);
+}
+
+template <typename T, typename F>
+void visit(const vector_ring<T> &r, F f) {
+  r.for_each(f);
+}
+
+// Misura e stampa: tempo e byte allocati durante body()
+template <typename F>
+void measure(const std::string &name, unsigned long ops, F body) {
+  unsigned long before = allocated.load(std::memory_order_relaxed);
+  bench::timer t;
+  body();
+  double ns = t.elapsed_ns();
+  unsigned long bytes = allocated.load(std::memory_order_relaxed) - before;
+  bench::report(name.c_str(), ns, ops, bytes);
+}
+
+template <typename R, typename T>
+void fill(R &r, unsigned int n) {
+  for(unsigned int i = 0; i < n; ++i)
+    r.enqueue(make_value<T>(i));
+}
+
+// enqueue di mezzo buffer e pop di mezzo buffer, a ripetizione
+template <typename R, typename T>
+void enqueue_pop(const std::string &name) {
+  R r(SIZE);
+  unsigned long rounds = OPS / SIZE;
+  measure(name + " enqueue+pop", rounds * SIZE, [&]() {
+    for(unsigned long k = 0; k < rounds; ++k) {
+      for(unsigned int i = 0; i < SIZE / 2; ++i)
+        r.enqueue(make_value<T>(i));
+      for(unsigned int i = 0; i < SIZE / 2; ++i)
+        r.pop();
+    }
+  });
+}
+
+// buffer sempre pieno: ogni enqueue sovrascrive il più vecchio
+template <typename R, typename T>
+void overwrite(const std::string &name) {
+  R r(SIZE);
+  fill<R, T>(r, SIZE);
+  T v = make_value<T>(7);
+  measure(name + " enqueue (pieno)", OPS, [&]() {
+    for(unsigned long i = 0; i < OPS; ++i)
+      r.enqueue(v);
+  });
+  bench::do_not_optimize(r[0]);
+}
+
+// operator[] su posizioni pseudo-casuali
+template <typename R, typename T>
+void random_access(const std::string &name) {
+  R r(SIZE);
+  fill<R, T>(r, SIZE + SIZE / 3);
+  long sum = 0;
+  unsigned int x = 12345;
+  measure(name + " operator[] casuale", OPS, [&]() {
+    for(unsigned long i = 0; i < OPS; ++i) {
+      x = x * 1664525u + 1013904223u;
+      sum += digest(r[x % SIZE]);
+    }
+  });
+  bench::do_not_optimize(sum);
+}
+
+template <typename R, typename T>
+void iteration(const std::string &name) {
+  R r(SIZE);
+  fill<R, T>(r, SIZE + SIZE / 3);
+  unsigned long rounds = OPS / SIZE;
+  long sum = 0;
+  measure(name + " iterazione", rounds * SIZE, [&]() {
+    for(unsigned long k = 0; k < rounds; ++k)
+      visit(r, [&sum](const T &v) { sum += digest(v); });
+  });
+  bench::do_not_optimize(sum);
+}
+
+// copia di un buffer pieno (ns e byte per elemento copiato)
+template <typename R, typename T>
+void copy(const std::string &name) {
+  R r(SIZE);
+  fill<R, T>(r, SIZE + SIZE / 3);
+  unsigned long rounds = OPS / SIZE / 4;
+  long sum = 0;
+  measure(name + " copia", rounds * SIZE, [&]() {
+    for(unsigned long k = 0; k < rounds; ++k) {
+      R c(r);
+      sum += digest(c[SIZE - 1]);
+    }
+  });
+  bench::do_not_optimize(sum);
+}
+
+// confronto di due buffer uguali ma con la testa in posizioni diverse
+template <typename R, typename T>
+void equals(const std::string &name) {
+  R a(SIZE), b(SIZE);
+  fill<R, T>(a, SIZE);
+  fill<R, T>(b, SIZE / 2);
+  fill<R, T>(b, SIZE);
+  unsigned long rounds = OPS / SIZE;
+  long same = 0;
+  measure(name + " equals", rounds * SIZE, [&]() {
+    for(unsigned long k = 0; k < rounds; ++k)
+      same += a.equals(b);
+  });
+  bench::do_not_optimize(same);
+}
+
+// passaggio di OPS elementi da un thread produttore a un consumatore
+template <typename Q, typename T>
+void handoff(const std::string &name) {
+  Q q(SIZE);
+  long sum = 0;
+  measure(name + " passaggio tra thread", HANDOFF, [&]() {
+    std::thread producer([&q]() {
+      for(unsigned long i = 0; i < HANDOFF; ++i) {
+        T v = make_value<T>(i);
+        while(!q.try_enqueue(v))
+          std::this_thread::yield();
+      }
+    });
+    T v;
+    for(unsigned long i = 0; i < HANDOFF; ++i) {
+      while(!q.try_dequeue(v))
+        std::this_thread::yield();
+      sum += digest(v);
+    }
+    producer.join();
+  });
+  bench::do_not_optimize(sum);
+}
+
+template <typename R, typename T>
+void single_thread(const std::string &name) {
+  enqueue_pop<R, T>(name);
+  overwrite<R, T>(name);
+  random_access<R, T>(name);
+  iteration<R, T>(name);
+  copy<R, T>(name);
+  equals<R, T>(name);
+}
+
+template <typename T>
+void run(const std::string &type) {
+  single_thread<cbuffer<T>, T>("cbuffer<" + type + ">");
+  single_thread<deque_ring<T>, T>("deque_ring<" + type + ">");
+  single_thread<vector_ring<T>, T>("vector_ring<" + type + ">");
+  handoff<spsc_cbuffer<T>, T>("spsc_cbuffer<" + type + ">");
+  handoff<locked_ring<cbuffer<T>, T>, T>("mutex+cbuffer<" + type + ">");
+  handoff<locked_ring<deque_ring<T>, T>, T>("mutex+deque_ring<" + type + ">");
+  handoff<locked_ring<vector_ring<T>, T>, T>("mutex+vector_ring<" + type + ">");
+}
+
+int main() {
+  run<int>("int");
+  run<pod64>("pod64");
+  run<std::string>("string");
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include "../aggregating_cbuffer.h"
+#include "../quantile_cbuffer.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+@file window_bench.cpp
+@brief Costo per tick delle statistiche di una finestra scorrevole:
+ricalcolo completo su cbuffer<double> contro aggregating_cbuffer, e p99
+con copia + nth_element contro quantile_cbuffer (esatto, treap e ddsketch), con una
+query a ogni tick oppure ogni 1000 o 100000 tick
+**/
+
+static const unsigned long TICKS = 2000000;
+
+static double sample(unsigned long i) {
+  return 100.0 + static_cast<double>((i * 2654435761u) % 1000) * 0.001;
+}
+
+// ad ogni tick si accoda un campione e si ricalcolano somma, minimo e massimo
+void recompute(const std::string &name, unsigned int size) {
+  cbuffer<double> cb(size);
+  unsigned long ticks = TICKS / size * 64;
+  double acc = 0;
+  for(unsigned int i = 0; i < size; ++i)      // finestra già piena
+    cb.enqueue(sample(i));
+  bench::timer t;
+  for(unsigned long i = 0; i < ticks; ++i) {
+    cb.enqueue(sample(i));
+    double s = 0, mn = cb[0], mx = cb[0];
+    cb.for_each_segment([&](const double *p, unsigned int n) {
+      for(unsigned int j = 0; j < n; ++j) {
+        s += p[j];
+        mn = p[j] < mn ? p[j] : mn;
+        mx = p[j] > mx ? p[j] : mx;
+      }
+    });
+    acc += s / cb.countelem() + mn + mx;
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(acc);
+  bench::report((name + " ricalcolo").c_str(), ns, ticks);
+}
+
+// stesso carico con le statistiche mantenute in modo incrementale
+void incremental(const std::string &name, unsigned int size) {
+  aggregating_cbuffer<double> w(size);
+  unsigned long ticks = TICKS;
+  double acc = 0;
+  for(unsigned int i = 0; i < size; ++i)
+    w.enqueue(sample(i));
+  bench::timer t;
+  for(unsigned long i = 0; i < ticks; ++i) {
+    w.enqueue(sample(i));
+    acc += w.mean() + w.min() + w.max() + w.variance();
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(acc);
+  bench::report((name + " aggregating_cbuffer").c_str(), ns, ticks);
+}
+
+// p99 con copia della finestra e nth_element (una query ogni query_every tick)
+void p99_nth_element(const std::string &name, unsigned int size, unsigned int query_every) {
+  cbuffer<double> cb(size);
+  std::vector<double> copy;
+  unsigned long ticks = TICKS / 4;
+  double acc = 0;
+  for(unsigned int i = 0; i < size; ++i)
+    cb.enqueue(sample(i));
+  bench::timer t;
+  for(unsigned long i = 0; i < ticks; ++i) {
+    cb.enqueue(sample(i));
+    if(i % query_every == 0) {
+      copy.assign(cb.begin(), cb.end());
+      std::size_t r = static_cast<std::size_t>(0.99 * (copy.size() - 1));
+      std::nth_element(copy.begin(), copy.begin() + r, copy.end());
+      acc += copy[r];
+    }
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(acc);
+  bench::report((name + " p99 nth_element").c_str(), ns, ticks);
+}
+
+template <typename Q>
+void p99_tracked(const std::string &name, unsigned int size, unsigned int query_every) {
+  Q q(size);
+  unsigned long ticks = TICKS / 4;
+  double acc = 0;
+  for(unsigned int i = 0; i < size; ++i)
+    q.enqueue(sample(i));
+  bench::timer t;
+  for(unsigned long i = 0; i < ticks; ++i) {
+    q.enqueue(sample(i));
+    if(i % query_every == 0)
+      acc += q.quantile(0.99);
+  }
+  double ns = t.elapsed_ns();
+  bench::do_not_optimize(acc);
+  bench::report(name.c_str(), ns, ticks);
+}
+
+int main() {
+  const unsigned int sizes[] = {64, 1024, 16384, 262144};
+  const unsigned int every[] = {1, 1000, 100000};   // 100000: una query al secondo a 100k tick/s
+  for(unsigned int i = 0; i < 4; ++i) {
+    std::string name = "finestra[" + std::to_string(sizes[i]) + "]";
+    recompute(name, sizes[i]);
+    incremental(name, sizes[i]);
+    for(unsigned int e = 0; e < 3; ++e) {
+      std::string qname = name + " ogni " + std::to_string(every[e]);
+      if(sizes[i] / every[e] <= 16384)   // il ricalcolo completo a ogni tick su 262144 dura minuti
+        p99_nth_element(qname, sizes[i], every[e]);
+      p99_tracked<quantile_cbuffer<double> >(qname + " p99 exact_quantiles", sizes[i], every[e]);
+      p99_tracked<quantile_cbuffer<double, treap_quantiles<double> > >(qname + " p99 treap_quantiles", sizes[i], every[e]);
+      p99_tracked<quantile_cbuffer<double, ddsketch_quantiles<double> > >(qname + " p99 ddsketch", sizes[i], every[e]);
+    }
+  }
+  return 0;
+}
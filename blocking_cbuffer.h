@@ -0,0 +1,320 @@
+#ifndef BLOCKING_CBUFF_H
+#define BLOCKING_CBUFF_H
+
+#include "cbuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+/**
+@file blocking_cbuffer.h
+@brief Dichiarazione della classe blocking_cbuffer
+**/
+
+/**
+Strategia di attesa: prima si controlla il numero di elementi senza lock
+per spin iterazioni (cedendo il processore ogni yield_every), poi ci si
+addormenta su una condition variable.
+**/
+struct wait_strategy {
+  unsigned int spin; ///< Iterazioni di attesa attiva prima di addormentarsi (0 = subito)
+  unsigned int yield_every; ///< Ogni quante iterazioni cedere il processore (0 = mai)
+
+  wait_strategy() : spin(2000), yield_every(64) {
+  }
+
+  wait_strategy(unsigned int s, unsigned int y) : spin(s), yield_every(y) {
+  }
+};
+
+/**
+Strato bloccante sopra cbuffer: i consumatori possono attendere gli elementi
+e i produttori lo spazio, con timeout, invece di interrogare isEmpty in un ciclo.
+Le notifiche partono solo se qualcuno sta effettivamente dormendo, quindi un
+enqueue senza attese pendenti non fa chiamate di sistema. Con una soglia
+(watermark) i consumatori vengono svegliati solo quando sono disponibili
+almeno watermark elementi, così i risvegli avvengono a blocchi.
+La politica di overflow decide cosa fa enqueue a buffer pieno: sovrascrive
+(overwrite_oldest, default), rifiuta (reject_new), attende spazio
+(block_when_full) o passa il più vecchio a una funzione (spill_oldest).
+**/
+template <typename T, typename Storage = heap_storage<T>, typename Overflow = overwrite_oldest>
+class blocking_cbuffer {
+public:
+  typedef unsigned int size_type;
+  typedef T value_type;
+  typedef cbuffer<T, Storage, no_stats, Overflow> buffer_type;
+
+  /**
+  @brief Costruttore
+  @param size dimensione del cbuffer sottostante
+  @param strategy strategia di attesa (spin poi sospensione)
+  **/
+  explicit blocking_cbuffer(size_type size, const wait_strategy &strategy = wait_strategy())
+  : _cb(size), _strategy(strategy), _count(0), _watermark(1),
+    _sleeping_consumers(0), _sleeping_producers(0) {
+  }
+
+  size_type capacity() const {
+    return _cb.capacity();
+  }
+
+  /**
+  @brief Numero di elementi presenti (letto senza lock)
+  **/
+  size_type countelem() const {
+    return _count.load(std::memory_order_acquire);
+  }
+
+  bool isEmpty() const {
+    return countelem() == 0;
+  }
+
+  /**
+  @brief Imposta la soglia di risveglio dei consumatori
+  @param n numero di elementi da attendere (ridotto a capacity(), almeno 1)
+  **/
+  void set_watermark(size_type n) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _watermark.store(std::max<size_type>(1, std::min(n, capacity())), std::memory_order_relaxed);
+    if(_sleeping_consumers != 0 && _cb.countelem() >= threshold())
+      _not_empty.notify_all();
+  }
+
+  size_type watermark() const {
+    return threshold();
+  }
+
+  /**
+  @brief Accoda secondo la politica di overflow: con block_when_full attende
+  che ci sia spazio, altrimenti si comporta come cbuffer::enqueue
+  @param value valore da accodare
+  @return false se il valore è stato rifiutato (reject_new)
+  **/
+  bool enqueue(const T &value) {
+    if constexpr (Overflow::blocks)
+      return enqueue_wait(value);
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool ok = _cb.enqueue(value);
+    after_enqueue();
+    return ok;
+  }
+
+  /**
+  @brief Accoda n valori con una sola notifica per ogni blocco scritto.
+  Con block_when_full attende lo spazio finché non li ha accodati tutti.
+  @param src indirizzo del primo valore
+  @param n numero di valori da accodare
+  @return numero di valori accodati
+  **/
+  size_type enqueue_n(const T *src, size_type n) {
+    if constexpr (Overflow::blocks) {
+      size_type done = 0;
+      std::unique_lock<std::mutex> lock(_mutex);
+      while(done < n) {
+        wait_space(lock, 0);
+        done += _cb.enqueue_n(src + done, n - done);
+        after_enqueue();
+      }
+      return done;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_type m = _cb.enqueue_n(src, n);
+    after_enqueue();
+    return m;
+  }
+
+  /**
+  @brief Accoda attendendo che ci sia spazio
+  @param value valore da accodare
+  @return true
+  **/
+  bool enqueue_wait(const T &value) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    wait_space(lock, 0);
+    _cb.enqueue(value);
+    after_enqueue();
+    return true;
+  }
+
+  /**
+  @brief Accoda attendendo al più timeout che ci sia spazio
+  @param value valore da accodare
+  @param timeout tempo massimo di attesa
+  @return false se allo scadere il buffer è ancora pieno
+  **/
+  template <typename Rep, typename Period>
+  bool enqueue_wait(const T &value, const std::chrono::duration<Rep, Period> &timeout) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!wait_space(lock, &deadline))
+      return false;
+    _cb.enqueue(value);
+    after_enqueue();
+    return true;
+  }
+
+  /**
+  @brief Toglie la testa senza attendere
+  @param out destinazione del valore
+  @return false se il buffer è vuoto
+  **/
+  bool try_dequeue(T &out) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_cb.isEmpty())
+      return false;
+    _cb.dequeue_n(&out, 1);
+    after_dequeue(1);
+    return true;
+  }
+
+  /**
+  @brief Toglie la testa attendendo che siano disponibili watermark() elementi
+  @param out destinazione del valore
+  @return true
+  **/
+  bool dequeue_wait(T &out) {
+    return dequeue_wait_n(&out, 1) == 1;
+  }
+
+  /**
+  @brief Come dequeue_wait(T&) ma attende al più timeout
+  @param out destinazione del valore
+  @param timeout tempo massimo di attesa
+  @return false se allo scadere il buffer è ancora vuoto
+  **/
+  template <typename Rep, typename Period>
+  bool dequeue_wait(T &out, const std::chrono::duration<Rep, Period> &timeout) {
+    return dequeue_wait_n(&out, 1, timeout) == 1;
+  }
+
+  /**
+  @brief Attende che siano disponibili watermark() elementi e ne toglie fino a n
+  @param out array di destinazione (almeno n elementi già costruiti)
+  @param n numero massimo di elementi da togliere
+  @return numero di elementi tolti
+  **/
+  size_type dequeue_wait_n(T *out, size_type n) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    wait_items(lock, 0);
+    size_type m = _cb.dequeue_n(out, n);
+    after_dequeue(m);
+    return m;
+  }
+
+  /**
+  @brief Come dequeue_wait_n(T*, size_type) ma attende al più timeout.
+  Allo scadere toglie gli elementi disponibili, anche se meno della soglia.
+  @param out array di destinazione (almeno n elementi già costruiti)
+  @param n numero massimo di elementi da togliere
+  @param timeout tempo massimo di attesa
+  @return numero di elementi tolti (0 se il buffer è rimasto vuoto)
+  **/
+  template <typename Rep, typename Period>
+  size_type dequeue_wait_n(T *out, size_type n, const std::chrono::duration<Rep, Period> &timeout) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(_mutex);
+    wait_items(lock, &deadline);
+    size_type m = _cb.dequeue_n(out, n);
+    after_dequeue(m);
+    return m;
+  }
+
+private:
+  blocking_cbuffer(const blocking_cbuffer &);
+  blocking_cbuffer &operator=(const blocking_cbuffer &);
+
+  // Attesa attiva senza lock finché ready() non è vero o finiscono le iterazioni
+  template <typename P>
+  void spin(P ready) const {
+    for(unsigned int i = 0; i < _strategy.spin; ++i) {
+      if(ready())
+        return;
+      if(_strategy.yield_every != 0 && (i + 1) % _strategy.yield_every == 0)
+        std::this_thread::yield();
+    }
+  }
+
+  // Attende (con il lock preso) che ci siano almeno watermark elementi.
+  // Ritorna false se è scaduto deadline.
+  bool wait_items(std::unique_lock<std::mutex> &lock, const std::chrono::steady_clock::time_point *deadline) {
+    if(_cb.countelem() >= threshold())
+      return true;
+    lock.unlock();
+    spin([this]() { return countelem() >= threshold(); });
+    lock.lock();
+    ++_sleeping_consumers;
+    bool ok = true;
+    if(deadline)
+      ok = _not_empty.wait_until(lock, *deadline, [this]() { return _cb.countelem() >= threshold(); });
+    else
+      _not_empty.wait(lock, [this]() { return _cb.countelem() >= threshold(); });
+    --_sleeping_consumers;
+    return ok;
+  }
+
+  // Attende (con il lock preso) che ci sia almeno una cella libera.
+  // Ritorna false se è scaduto deadline.
+  bool wait_space(std::unique_lock<std::mutex> &lock, const std::chrono::steady_clock::time_point *deadline) {
+    if(!_cb.isFull())
+      return true;
+    lock.unlock();
+    spin([this]() { return countelem() < capacity(); });
+    lock.lock();
+    ++_sleeping_producers;
+    bool ok = true;
+    if(deadline)
+      ok = _not_full.wait_until(lock, *deadline, [this]() { return !_cb.isFull(); });
+    else
+      _not_full.wait(lock, [this]() { return !_cb.isFull(); });
+    --_sleeping_producers;
+    return ok;
+  }
+
+  // Soglia di risveglio: scritta con il lock preso, letta anche durante lo spin
+  // senza lock (lì è solo un suggerimento, la condizione viene ricontrollata)
+  size_type threshold() const {
+    return _watermark.load(std::memory_order_relaxed);
+  }
+
+  // Dopo un inserimento (con il lock preso): pubblica il conteggio e sveglia
+  // i consumatori solo se dormono e la soglia è raggiunta
+  void after_enqueue() {
+    size_type n = _cb.countelem();
+    _count.store(n, std::memory_order_release);
+    if(_sleeping_consumers != 0 && n >= threshold()) {
+      if(_sleeping_consumers > 1 && n >= 2 * threshold())
+        _not_empty.notify_all();
+      else
+        _not_empty.notify_one();
+    }
+  }
+
+  // Dopo un'estrazione di freed elementi (con il lock preso): pubblica il
+  // conteggio e sveglia i produttori solo se qualcuno attende spazio; se si
+  // è liberata più di una cella li sveglia tutti, altrimenti quelli rimasti
+  // addormentati non vedrebbero lo spazio libero
+  void after_dequeue(size_type freed) {
+    _count.store(_cb.countelem(), std::memory_order_release);
+    if(_sleeping_producers == 0 || freed == 0)
+      return;
+    if(freed > 1 && _sleeping_producers > 1)
+      _not_full.notify_all();
+    else
+      _not_full.notify_one();
+  }
+
+  buffer_type _cb; ///< Buffer protetto da _mutex
+  wait_strategy _strategy; ///< Parametri dell'attesa attiva
+  std::atomic<size_type> _count; ///< Copia di _cb.countelem() leggibile senza lock
+  std::atomic<size_type> _watermark; ///< Soglia di risveglio dei consumatori
+  unsigned int _sleeping_consumers; ///< Consumatori addormentati su _not_empty
+  unsigned int _sleeping_producers; ///< Produttori addormentati su _not_full
+  mutable std::mutex _mutex;
+  std::condition_variable _not_empty;
+  std::condition_variable _not_full;
+};
+
+#endif
@@ -6,28 +6,647 @@
 #include <cassert>
 #include <algorithm>
 #include <stdexcept>
-#include <iterator> // std::forward_iterator_tag
+#include <iterator> // std::random_access_iterator_tag, std::reverse_iterator
 #include <cstddef>  // std::ptrdiff_t
+#include <new>      // placement new, std::align_val_t
+#include <utility>  // std::forward, std::move
+#include <type_traits>
+#include <cstring>  // std::memcpy
+#include <atomic>
+#include <memory>   // std::allocator, std::allocator_traits
+#include <cstdint>
+#include <istream>
+#include <functional> // std::less
+#include <vector>
+#include "cbuffer_simd.h"
 /**
 @file cbuffer.h
 @brief Dichiarazione della classe cbuffer
 **/
 
 /**
-Classe che rappresenta un buffer circolare di un tipo t
+Funzioni di supporto comuni alle politiche di memorizzazione.
+Le politiche forniscono memoria grezza: gli elementi vengono costruiti
+e distrutti da cbuffer solo quando sono effettivamente presenti.
+**/
+namespace cbuffer_detail {
+
+/**
+@brief Alloca memoria non inizializzata e allineata per n elementi di tipo T
+**/
+template <typename T>
+T *allocate_raw(std::size_t n) {
+  if(n == 0)
+    return 0;
+  if(alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+  return static_cast<T*>(::operator new(n * sizeof(T)));
+}
+
+/**
+@brief Rilascia memoria ottenuta con allocate_raw (non distrugge gli elementi)
 **/
 template <typename T>
-class cbuffer {
+void deallocate_raw(T *p) {
+  if(p == 0)
+    return;
+  if(alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    ::operator delete(p, std::align_val_t(alignof(T)));
+  else
+    ::operator delete(p);
+}
+
+/**
+@brief Alloca con l'allocatore a memoria non inizializzata per n elementi
+(0 elementi: nessuna allocazione)
+**/
+template <typename T, typename A>
+T *allocate_with(A &alloc, std::size_t n) {
+  if(n == 0)
+    return 0;
+  return std::allocator_traits<A>::allocate(alloc, n);
+}
+
+/**
+@brief Rilascia memoria ottenuta con allocate_with (non distrugge gli elementi)
+**/
+template <typename T, typename A>
+void deallocate_with(A &alloc, T *p, std::size_t n) {
+  if(p != 0)
+    std::allocator_traits<A>::deallocate(alloc, p, n);
+}
+
+// Vero se la politica di memorizzazione ha un allocatore (allocator_type)
+template <typename S, typename = void>
+struct has_allocator : std::false_type {
+};
+
+template <typename S>
+struct has_allocator<S, std::void_t<typename S::allocator_type> > : std::true_type {
+};
+
+// Vero se la politica arrotonda la capacità richiesta (S::round_up)
+template <typename S, typename = void>
+struct has_round_up : std::false_type {
+};
+
+template <typename S>
+struct has_round_up<S, std::void_t<decltype(S::round_up(0u))> > : std::true_type {
+};
+
+/**
+@brief Capacità che la politica S avrebbe se le si chiedessero n celle
+**/
+template <typename S>
+unsigned int storage_capacity(unsigned int n) {
+  if constexpr (has_round_up<S>::value)
+    return S::round_up(n);
+  else
+    return n;
+}
+
+/**
+@brief Nuova politica di memorizzazione di n celle che usa lo stesso
+allocatore di like (per copie e ricollocazioni)
+**/
+template <typename S>
+S storage_like(const S &like, unsigned int n) {
+  if constexpr (has_allocator<S>::value)
+    return S(n, like.get_allocator());
+  else
+    return S(n);
+}
+
+} // namespace cbuffer_detail
+
+/**
+Politica di memorizzazione di default per cbuffer: array non inizializzato
+allocato sullo heap con capacità esattamente uguale a quella richiesta.
+La politica si occupa anche di riportare gli indici nel range [0, capacity)
+@tparam Alloc allocatore nel modello standard (std::allocator di default,
+pool_allocator o hugepage_allocator di cbuffer_alloc.h); è una base vuota
+se non ha stato
+**/
+template <typename T, typename Alloc = std::allocator<T> >
+class heap_storage : private Alloc {
+public:
+  typedef unsigned int size_type;
+  typedef Alloc allocator_type;
+
+  heap_storage() : Alloc(), _data(0), _capacity(0) {
+  }
+
+  explicit heap_storage(size_type size, const Alloc &alloc = Alloc()) : Alloc(alloc), _data(0), _capacity(0) {
+    _data = cbuffer_detail::allocate_with<T>(get_allocator(), size);
+    _capacity = size;
+  }
+
+  ~heap_storage() {
+    cbuffer_detail::deallocate_with(get_allocator(), _data, _capacity);
+  }
+
+  allocator_type &get_allocator() {
+    return *this;
+  }
+
+  const allocator_type &get_allocator() const {
+    return *this;
+  }
+
+  T *data() {
+    return _data;
+  }
+
+  const T *data() const {
+    return _data;
+  }
+
+  size_type capacity() const {
+    return _capacity;
+  }
+
+  /**
+  @brief Riporta un indice nel range [0, capacity) senza salti condizionati
+  (il confronto viene tradotto in una cmov)
+  @pre i < 2 * capacity
+  @param i indice da riportare nel range
+  @return indice fisico della cella
+  **/
+  size_type wrap(size_type i) const {
+    return i >= _capacity ? i - _capacity : i;
+  }
+
+  /**
+  @brief Cella corrispondente a un contatore che cresce senza limiti
+  @param seq contatore (ad esempio la coda di spsc_cbuffer)
+  @return seq modulo capacity
+  **/
+  size_type mod(std::size_t seq) const {
+    return static_cast<size_type>(seq % _capacity);
+  }
+
+  // Lo stato degli indici vive solo in cbuffer (vedi mmap_storage)
+  static void load_state(size_type &f, size_type &n) {
+    f = 0;
+    n = 0;
+  }
+
+  static void store_state(size_type, size_type) {
+  }
+
+  static const bool pointer_swap = true; ///< swap scambia solo i puntatori
+  static const bool growable = true; ///< cbuffer può sostituire l'array con uno di capacità diversa
+
+  // L'array non è mappato due volte di seguito (vedi vmring_storage)
+  static bool mirrored() {
+    return false;
+  }
+
+  void swap(heap_storage &other) {
+    using std::swap;
+    swap(get_allocator(), other.get_allocator());
+    std::swap(_data, other._data);
+    std::swap(_capacity, other._capacity);
+  }
+
+private:
+  heap_storage(const heap_storage &);
+  heap_storage &operator=(const heap_storage &);
+
+  T *_data; ///< Puntatore all'array
+  size_type _capacity; ///< Numero di celle dell'array
+};
+
+/**
+Politica di memorizzazione opzionale: la capacità richiesta viene arrotondata
+alla potenza di due successiva, così che il ritorno a capo degli indici
+diventi una semplice maschera di bit.
+@tparam Alloc allocatore nel modello standard (come per heap_storage)
+**/
+template <typename T, typename Alloc = std::allocator<T> >
+class pow2_storage : private Alloc {
+public:
+  typedef unsigned int size_type;
+  typedef Alloc allocator_type;
+
+  pow2_storage() : Alloc(), _data(0), _capacity(0), _mask(0) {
+  }
+
+  explicit pow2_storage(size_type size, const Alloc &alloc = Alloc()) : Alloc(alloc), _data(0), _capacity(0), _mask(0) {
+    size_type cap = round_up(size);
+    _data = cbuffer_detail::allocate_with<T>(get_allocator(), cap);
+    _capacity = cap;
+    _mask = cap - 1;
+  }
+
+  ~pow2_storage() {
+    cbuffer_detail::deallocate_with(get_allocator(), _data, _capacity);
+  }
+
+  allocator_type &get_allocator() {
+    return *this;
+  }
+
+  const allocator_type &get_allocator() const {
+    return *this;
+  }
+
+  T *data() {
+    return _data;
+  }
+
+  const T *data() const {
+    return _data;
+  }
+
+  size_type capacity() const {
+    return _capacity;
+  }
+
+  /**
+  @brief Riporta un indice nel range [0, capacity) con una maschera
+  @param i indice da riportare nel range
+  @return indice fisico della cella
+  **/
+  size_type wrap(size_type i) const {
+    return i & _mask;
+  }
+
+  /**
+  @brief Cella corrispondente a un contatore che cresce senza limiti
+  @param seq contatore (ad esempio la coda di spsc_cbuffer)
+  @return seq modulo capacity, calcolato con la maschera
+  **/
+  size_type mod(std::size_t seq) const {
+    return static_cast<size_type>(seq & _mask);
+  }
+
+  // Lo stato degli indici vive solo in cbuffer (vedi mmap_storage)
+  static void load_state(size_type &f, size_type &n) {
+    f = 0;
+    n = 0;
+  }
+
+  static void store_state(size_type, size_type) {
+  }
+
+  static const bool pointer_swap = true; ///< swap scambia solo i puntatori
+  static const bool growable = true; ///< cbuffer può sostituire l'array con uno di capacità diversa
+
+  // L'array non è mappato due volte di seguito (vedi vmring_storage)
+  static bool mirrored() {
+    return false;
+  }
+
+  void swap(pow2_storage &other) {
+    using std::swap;
+    swap(get_allocator(), other.get_allocator());
+    std::swap(_data, other._data);
+    std::swap(_capacity, other._capacity);
+    std::swap(_mask, other._mask);
+  }
+
+  /**
+  @brief Potenza di due maggiore o uguale a n (0 resta 0)
+  **/
+  static size_type round_up(size_type n) {
+    if(n <= 1)
+      return n;
+    --n;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    return n + 1;
+  }
+
+private:
+  pow2_storage(const pow2_storage &);
+  pow2_storage &operator=(const pow2_storage &);
+
+  T *_data; ///< Puntatore all'array
+  size_type _capacity; ///< Numero di celle dell'array (potenza di due)
+  size_type _mask; ///< capacity - 1
+};
+
+/**
+Politica di memorizzazione a capacità fissata a tempo di compilazione:
+le celle (non inizializzate) sono contenute direttamente nell'oggetto (nessuna allocazione)
+e l'aritmetica degli indici usa la costante N (maschera se N è potenza di due).
+**/
+template <typename T, unsigned int N>
+class inline_storage {
+public:
+  typedef unsigned int size_type;
+
+  static const size_type static_capacity = N; ///< Capacità nota a tempo di compilazione
+
+  inline_storage() {
+  }
+
+  /**
+  @brief Costruttore con dimensione richiesta
+  La capacità resta sempre N, la dimensione serve solo a mantenere
+  la stessa interfaccia delle politiche dinamiche.
+  @param size dimensione richiesta
+  @throw std::length_error se size > N
+  **/
+  explicit inline_storage(size_type size) {
+    if(size > N)
+      throw std::length_error("inline_storage: dimensione richiesta maggiore di N");
+  }
+
+  T *data() {
+    return reinterpret_cast<T*>(_raw);
+  }
+
+  const T *data() const {
+    return reinterpret_cast<const T*>(_raw);
+  }
+
+  static size_type capacity() {
+    return N;
+  }
+
+  /**
+  @brief Riporta un indice nel range [0, N)
+  @pre i < 2 * N (se N non è potenza di due)
+  @param i indice da riportare nel range
+  @return indice fisico della cella
+  **/
+  static size_type wrap(size_type i) {
+    if(is_pow2)
+      return i & (N - 1);
+    return i >= N ? i - N : i;
+  }
+
+  /**
+  @brief Cella corrispondente a un contatore che cresce senza limiti
+  @param seq contatore (ad esempio la coda di spsc_cbuffer)
+  @return seq modulo N (costante nota al compilatore)
+  **/
+  static size_type mod(std::size_t seq) {
+    return static_cast<size_type>(seq % N);
+  }
+
+  // Lo stato degli indici vive solo in cbuffer (vedi mmap_storage)
+  static void load_state(size_type &f, size_type &n) {
+    f = 0;
+    n = 0;
+  }
+
+  static void store_state(size_type, size_type) {
+  }
+
+  // Le celle non si possono scambiare senza sapere quali sono vive:
+  // cbuffer scambia gli elementi uno per uno
+  static const bool pointer_swap = false;
+  static const bool growable = false; ///< la capacità è fissata dal parametro N
+
+  static bool mirrored() {
+    return false;
+  }
+
+private:
+  static const bool is_pow2 = (N & (N - 1)) == 0;
+
+  inline_storage(const inline_storage &);
+  inline_storage &operator=(const inline_storage &);
+
+  alignas(T) unsigned char _raw[sizeof(T) * (N == 0 ? 1 : N)]; ///< Celle contenute nell'oggetto
+};
+
+/**
+Politica delle statistiche di default: nessun contatore. I metodi sono
+vuoti e la classe è una base vuota di cbuffer, quindi non occupa spazio
+e le chiamate spariscono in compilazione.
+**/
+struct no_stats {
+  static void on_enqueue(unsigned int, unsigned int, unsigned int, unsigned int) {
+  }
+
+  static void on_pop(unsigned int, unsigned int, unsigned int) {
+  }
+
+  static void on_drop(unsigned int, unsigned int, unsigned int) {
+  }
+};
+
+/**
+Politica delle statistiche con contatori: inserimenti, estrazioni,
+sovrascritture del più vecchio, elementi scartati senza essere letti
+(clear, inserimenti rifiutati), massimo numero di elementi raggiunto e un
+istogramma dell'occupazione campionata a ogni operazione (il secchio k
+conta i campioni con occupazione in [k/BUCKETS, (k+1)/BUCKETS) della
+capacità, il buffer pieno cade nell'ultimo).
+Scrive solo il thread che usa il cbuffer, con load e store relaxed senza
+istruzioni atomiche read-modify-write; un thread di monitoraggio può
+leggere i contatori in qualsiasi momento.
+Le copie di un cbuffer ripartono con i contatori a zero.
+**/
+class counting_stats {
+public:
+  typedef unsigned int size_type;
+  typedef unsigned long long counter_type;
+
+  static const size_type BUCKETS = 16;
+
+  counting_stats() : _enqueues(0), _pops(0), _overwrites(0), _drops(0), _high_water(0),
+    _cap(0), _scale(0) {
+    for(size_type k = 0; k < BUCKETS; ++k)
+      _histogram[k].store(0, std::memory_order_relaxed);
+  }
+
+  /**
+  @brief n elementi accodati, di cui overwritten hanno preso il posto dei più vecchi
+  **/
+  void on_enqueue(size_type n, size_type overwritten, size_type count, size_type cap) {
+    bump(_enqueues, n);
+    if(overwritten != 0)
+      bump(_overwrites, overwritten);
+    if(count > _high_water.load(std::memory_order_relaxed))
+      _high_water.store(count, std::memory_order_relaxed);
+    sample(count, cap);
+  }
+
+  void on_pop(size_type n, size_type count, size_type cap) {
+    bump(_pops, n);
+    sample(count, cap);
+  }
+
+  void on_drop(size_type n, size_type count, size_type cap) {
+    bump(_drops, n);
+    sample(count, cap);
+  }
+
+  counter_type enqueues() const {
+    return _enqueues.load(std::memory_order_relaxed);
+  }
+
+  counter_type pops() const {
+    return _pops.load(std::memory_order_relaxed);
+  }
+
+  counter_type overwrites() const {
+    return _overwrites.load(std::memory_order_relaxed);
+  }
+
+  counter_type drops() const {
+    return _drops.load(std::memory_order_relaxed);
+  }
+
+  size_type high_water() const {
+    return _high_water.load(std::memory_order_relaxed);
+  }
+
+  /**
+  @brief Numero di campioni nel secchio k dell'istogramma dell'occupazione
+  @pre k < BUCKETS
+  **/
+  counter_type histogram(size_type k) const {
+    return _histogram[k].load(std::memory_order_relaxed);
+  }
+
+private:
+  counting_stats(const counting_stats &);
+  counting_stats &operator=(const counting_stats &);
+
+  // Incremento da parte dell'unico scrittore
+  static void bump(std::atomic<counter_type> &c, counter_type n) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // Secchio dell'occupazione: la divisione si fa solo quando cambia la capacità
+  void sample(size_type count, size_type cap) {
+    if(cap != _cap) {
+      _cap = cap;
+      _scale = cap == 0 ? 0 : (static_cast<counter_type>(BUCKETS) << 32) / cap;
+    }
+    size_type k = static_cast<size_type>((count * _scale) >> 32);
+    bump(_histogram[k < BUCKETS ? k : BUCKETS - 1], 1);
+  }
+
+  std::atomic<counter_type> _enqueues; ///< Elementi accodati
+  std::atomic<counter_type> _pops; ///< Elementi tolti dalla testa (letti)
+  std::atomic<counter_type> _overwrites; ///< Elementi persi perché sovrascritti
+  std::atomic<counter_type> _drops; ///< Elementi scartati senza essere letti
+  std::atomic<size_type> _high_water; ///< Massimo numero di elementi raggiunto
+  std::atomic<counter_type> _histogram[BUCKETS]; ///< Istogramma dell'occupazione
+  size_type _cap; ///< Capacità per cui è calcolato _scale
+  counter_type _scale; ///< BUCKETS / capacità in virgola fissa 32.32
+};
+
+/**
+Comportamento di cbuffer quando si accoda in un buffer pieno
+**/
+enum overflow_action {
+  overflow_overwrite, ///< L'elemento più vecchio viene sovrascritto
+  overflow_reject,    ///< Il nuovo elemento viene rifiutato
+  overflow_spill,     ///< L'elemento più vecchio viene passato alla politica e poi sovrascritto
+  overflow_grow       ///< La capacità viene aumentata (vedi cbuffer::reserve)
+};
+
+/**
+Politica di overflow di default: sovrascrive l'elemento più vecchio
+**/
+struct overwrite_oldest {
+  static const overflow_action action = overflow_overwrite;
+  static const bool blocks = false; ///< I wrapper bloccanti non attendono spazio
+};
+
+/**
+Politica di overflow: a buffer pieno enqueue ritorna false e il valore
+viene scartato (contato tra i drops di counting_stats)
+**/
+struct reject_new {
+  static const overflow_action action = overflow_reject;
+  static const bool blocks = false;
+};
+
+/**
+Politica di overflow: attende che si liberi spazio. Un cbuffer usato da un
+solo thread non può attendere, quindi si comporta come reject_new;
+blocking_cbuffer invece mette in attesa il produttore in enqueue.
+**/
+struct block_when_full {
+  static const overflow_action action = overflow_reject;
+  static const bool blocks = true;
+};
+
+/**
+Politica di overflow: prima di essere sovrascritto l'elemento più vecchio
+viene spostato nel funtore spill (ad esempio per salvarlo su un archivio
+secondario). F deve essere costruibile di default; per una lambda si può
+usare std::function e assegnarla con cbuffer::overflow().spill = ...
+@tparam F funtore chiamato come spill(T&&)
+**/
+template <typename F>
+struct spill_oldest {
+  static const overflow_action action = overflow_spill;
+  static const bool blocks = false;
+
+  F spill; ///< Destinazione degli elementi espulsi
+
+  template <typename U>
+  void evict(U &&value) {
+    spill(std::forward<U>(value));
+  }
+};
+
+/**
+Politica di overflow: a buffer pieno la capacità viene moltiplicata per
+Num / Den (almeno una cella in più) e gli elementi vengono ricollocati in
+ordine a partire dalla cella 0. Richiede una politica di memorizzazione
+con growable (non inline_storage né mmap_storage).
+@tparam Num numeratore del fattore di crescita
+@tparam Den denominatore del fattore di crescita
+**/
+template <unsigned int Num = 2, unsigned int Den = 1>
+struct grow_when_full {
+  static_assert(Num > Den && Den != 0, "il fattore di crescita deve essere maggiore di 1");
+
+  static const overflow_action action = overflow_grow;
+  static const bool blocks = false;
+
+  /**
+  @brief Capacità dopo una crescita a partire da cap
+  **/
+  static unsigned int next_capacity(unsigned int cap) {
+    unsigned long long n = static_cast<unsigned long long>(cap) * Num / Den;
+    return n > cap ? static_cast<unsigned int>(n) : cap + 1;
+  }
+};
+
+/**
+Classe che rappresenta un buffer circolare di un tipo t.
+Lo stato degli indici è dato dalla posizione dell'elemento più vecchio (first)
+e dal numero di elementi contenuti (nelem).
+@tparam Storage politica di memorizzazione (heap_storage, pow2_storage, inline_storage
+o vmring_storage)
+@tparam Stats politica delle statistiche (no_stats o counting_stats)
+@tparam Overflow politica di overflow (overwrite_oldest, reject_new, block_when_full
+o spill_oldest<F>), scelta in compilazione
+**/
+template <typename T, typename Storage = heap_storage<T>, typename Stats = no_stats,
+          typename Overflow = overwrite_oldest>
+class cbuffer : private Stats, private Overflow {
 public:
   typedef unsigned int size_type; ///< Definzione del tipo corrispondente a size
   typedef T value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef Storage storage_type;
+  typedef Stats stats_type;
+  typedef Overflow overflow_type;
+  typedef std::pair<T*, size_type> array_range; ///< Tratto contiguo (puntatore, lunghezza)
+  typedef std::pair<const T*, size_type> const_array_range; ///< Tratto contiguo in sola lettura
 
   /**
   @brief Costruttore di default (METODO FONDAMENTALE)
   Costruttore di default per istanziare un cbuffer vuoto.
   **/
 
-  cbuffer(): _size(0), _buffer(0), first(0), last(0), freespace(0) {
+  cbuffer(): _storage(), first(0), nelem(0) {
   }
 
   /**
@@ -37,12 +656,7 @@ public:
   @param size Dimensione del cbuffer da istanziare
   **/
 
-  explicit cbuffer(size_type size) : _size(0), _buffer(0), first(0), last(0), freespace(0)  {
-    _buffer = new T[size];
-    _size = size;
-    first = 0;
-    last = 0;
-    freespace = size;
+  explicit cbuffer(size_type size) : _storage(size), first(0), nelem(0)  {
   }
 
   /**
@@ -54,20 +668,13 @@ public:
   @param value Valore da usare per inizizalizzare le celle dell'array
   **/
 
-  cbuffer(size_type size, const T &value) : _size(0), _buffer(0), first(0), last(0), freespace(0)  {
-    _buffer = new T[size];
-    _size = size;
-    first = 0;
-    last = size - 1;
-    freespace = 0;
+  cbuffer(size_type size, const T &value) : _storage(size), first(0), nelem(0)  {
     try {
-      for(size_type i=0 ; i < _size; ++i)
-      _buffer[i] = value;
+      for(size_type i=0 ; i < size; ++i)
+        emplace(value);
     }
     catch(...) {
-      delete[] _buffer;
-      _size = 0;
-      _buffer = 0;
+      clear();
       throw;
     }
   }
@@ -81,20 +688,13 @@ public:
   @param arr Indirizzo cella iniziale array
   **/
 
-  cbuffer(size_type size, const T* arr) : _size(0), _buffer(0), first(0), last(0), freespace(0)  {
-    _buffer = new T[size];
-    _size = size;
-    first = 0;
-    last = size - 1;
-    freespace = 0;
+  cbuffer(size_type size, const T* arr) : _storage(size), first(0), nelem(0)  {
     try {
-      for(size_type i=0 ; i < _size; ++i)
-      _buffer[i] = *(arr+i);
+      if(size != 0)
+        enqueue_n(arr, size);
     }
     catch(...) {
-      delete[] _buffer;
-      _size = 0;
-      _buffer = 0;
+      clear();
       throw;
     }
   }
@@ -111,49 +711,60 @@ public:
   **/
 
   template <typename I>
-  cbuffer(size_type size,I begin, I end) : _buffer(0), _size(0), first(0), last(0), freespace(0) {
+  cbuffer(size_type size,I begin, I end) : _storage(size), first(0), nelem(0) {
     try {
-      _buffer = new T[size];
-      first = 0;
-      last = size - 1;
-      _size = size;
-      freespace = 0;
-      for(; begin!=end; ++begin)
-		    enqueue(static_cast<T>(*begin));
-		}
-		catch(...) {
-			throw;
-		}
-	}
+      if(begin != end)
+        enqueue_n(begin, end);
+    }
+    catch(...) {
+      clear();
+      throw;
+    }
+  }
+
+  /**
+  @brief Costruttore secondario
+
+  Costruisce la politica di memorizzazione con gli argomenti dati e ne
+  recupera lo stato degli indici (con mmap_storage: il contenuto salvato
+  nel file). Con le altre politiche il cbuffer parte vuoto.
+  @param args argomenti per il costruttore di Storage
+  **/
+
+  template <typename... A>
+  explicit cbuffer(std::in_place_t, A&&... args) : _storage(std::forward<A>(args)...), first(0), nelem(0) {
+    _storage.load_state(first, nelem);
+  }
 
   /**
   @brief Copy constructor (METODO FONDAMENTALE)
 
   Costruttore di copia. Permette di istanziare un cbuffer con i valori
-  presi da un altro cbuffer.
+  presi da un altro cbuffer. Vengono copiati solo gli elementi presenti,
+  riportati in ordine a partire dalla cella 0.
   @param other cbuffer da usare per creare quello corrente
   **/
 
-  cbuffer(const cbuffer &other) : _size(0), _buffer(0), first(0), last(0), freespace(0)  {
-    _buffer = new T[other._size];
-    _size = other._size;
-    freespace = other._size;
-    try {
-      for(size_type i=0; i<_size; ++i){
-        _buffer[i] = other._buffer[i];
-        freespace = freespace - 1;
-      }
-      first = other.first;
-      last = other.last;
-    }
-    catch(...) {
-      delete[] _buffer;
-      _size = 0;
-      _buffer = 0;
-      first = 0;
-      last = 0;
-      freespace = 0;
-      throw;
+  cbuffer(const cbuffer &other) : Stats(), Overflow(other.overflow()),
+    _storage(cbuffer_detail::storage_like(other._storage, other.capacity())), first(0), nelem(0)  {
+    copy_live(other);
+  }
+
+  /**
+  @brief Move constructor (METODO FONDAMENTALE)
+
+  Costruttore di spostamento. Con memoria sullo heap prende possesso
+  dell'array di other senza copiare nulla; con inline_storage sposta
+  gli elementi uno per uno. other resta vuoto.
+  @param other cbuffer da cui spostare i dati
+  **/
+
+  cbuffer(cbuffer &&other) noexcept(nothrow_relocate) : _storage(), first(0), nelem(0)  {
+    if constexpr (Storage::pointer_swap)
+      swap(other);
+    else {
+      move_all(other, *this);
+      swap_policies(other);
     }
   }
 
@@ -167,12 +778,42 @@ public:
 
 cbuffer &operator=(const cbuffer &other) {
   if (this != &other) {
-    // Proviamo a copiare i nuovi dati in un cbuffer di appoggio
-    // Se la copia fallisce, viene lanciata una eccezione
-    cbuffer tmp(other);
-    // Se la copia riesce, scambiamo i dati di this con quelli del cbuffer di appoggio
-    this->swap(tmp);
-    // All'uscita dell'if, tmp viene automaticamente distrutto
+    if (capacity() == other.capacity()) {
+      // Stessa capacità: riusiamo l'array già allocato
+      destroy_all();
+      copy_live(other);
+    }
+    else {
+      // Proviamo a copiare i nuovi dati in un cbuffer di appoggio
+      // Se la copia fallisce, viene lanciata una eccezione
+      cbuffer tmp(other);
+      // Se la copia riesce, scambiamo i dati di this con quelli del cbuffer di appoggio
+      this->swap(tmp);
+      // All'uscita dell'if, tmp viene automaticamente distrutto
+    }
+    overflow() = other.overflow();
+  }
+  return *this;
+}
+
+/**
+@brief Operatore di assegnamento per spostamento (METODO FONDAMENTALE)
+
+Operatore di assegnamento per spostamento. Gli elementi di this vengono
+distrutti, quelli di other spostati (o l'array ceduto) in this.
+@param other cbuffer sorgente, resta vuoto
+@return riferimento a this
+**/
+
+cbuffer &operator=(cbuffer &&other) noexcept(nothrow_relocate) {
+  if (this != &other) {
+    destroy_all();
+    if constexpr (Storage::pointer_swap)
+      swap(other);
+    else {
+      move_all(other, *this);
+      swap_policies(other);
+    }
   }
   return *this;
 }
@@ -180,16 +821,14 @@ cbuffer &operator=(const cbuffer &other) {
 /**
 @brief Distruttore (METODO FONDAMENTALE)
 
-Distruttore. Rimuove la memoria allocata da cbuffer.
+Distruttore. Distrugge gli elementi presenti, la memoria allocata viene
+rilasciata dalla politica di memorizzazione.
 **/
 
 ~cbuffer() {
-  delete[] _buffer;
-  _buffer = 0;
-  _size = 0;
-  last = 0;
-  first = 0;
-  freespace = 0;
+  // niente clear(): con mmap_storage lo stato salvato deve sopravvivere
+  if constexpr (!std::is_trivially_destructible<T>::value)
+    drop_front(nelem);
 }
 
 /**
@@ -198,44 +837,424 @@ Funzione che ritorna il valore di empty
 **/
 
 bool isEmpty() const{
-  return freespace == _size;
+  return nelem == 0;
+}
+
+/**
+@brief Funzione che ritorna se la coda è piena o no
+**/
+
+bool isFull() const{
+  return nelem == capacity();
+}
+
+/**
+@brief Numero di celle del cbuffer
+Numero di celle del cbuffer (con pow2_storage è la dimensione richiesta
+arrotondata alla potenza di due successiva)
+**/
+
+size_type capacity() const{
+  return _storage.capacity();
 }
 
 /**
 @brief Accoda un valore al cbuffer
-Accoda un valore al cbuffer
+Accoda un valore al cbuffer. Se il buffer è pieno decide la politica di
+overflow: con overwrite_oldest (default) viene sovrascritto l'elemento più
+vecchio, con spill_oldest viene prima passato alla politica, con reject_new
+e block_when_full il valore viene scartato.
 @param value valore da accodare
+@return false se il valore è stato rifiutato perché il buffer è pieno
 **/
 
 bool enqueue(const T &value){
-  assert(_size != 0);
-  if(first == last + 1){ //il buffer è pieno e gli indici sono in mezzo (circolare)
-    _buffer[first] = value;
-    first = (first + 1) % (_size - 1);
-    last = (last + 1);
+  return emplace(value);
+}
+
+/**
+@brief Accoda un valore al cbuffer spostandolo
+@param value valore da accodare
+@return false se il valore è stato rifiutato perché il buffer è pieno
+**/
+
+bool enqueue(T &&value){
+  return emplace(std::move(value));
+}
+
+/**
+@brief Costruisce un elemento in coda direttamente nella cella del cbuffer
+Se il buffer è pieno si applica la politica di overflow (vedi enqueue).
+Per T banalmente distruttibile gli indici vengono aggiornati senza salti condizionati.
+@param args argomenti per il costruttore di T
+@return false se il valore è stato rifiutato perché il buffer è pieno
+**/
+
+template <typename... Args>
+bool emplace(Args&&... args){
+  if constexpr (Overflow::action == overflow_reject) {
+    if(isFull()) {
+      Stats::on_drop(1, nelem, capacity());
+      return false;
+    }
+  }
+  else if constexpr (Overflow::action == overflow_spill) {
+    if(isFull()) {
+      // il valore viene costruito prima di cedere il più vecchio, che args può riferire
+      T value(std::forward<Args>(args)...);
+      Overflow::evict(std::move(_storage.data()[first]));
+      size_type overwritten = emplace_back(std::move(value));
+      Stats::on_enqueue(1, overwritten, nelem, capacity());
+      return true;
+    }
+  }
+  else if constexpr (Overflow::action == overflow_grow) {
+    if(isFull()) {
+      // il valore viene costruito prima: args può riferirsi a un elemento del buffer
+      T value(std::forward<Args>(args)...);
+      relocate(Overflow::next_capacity(capacity()));
+      emplace_back(std::move(value));
+      Stats::on_enqueue(1, 0, nelem, capacity());
+      return true;
+    }
+  }
+  size_type overwritten = emplace_back(std::forward<Args>(args)...);
+  Stats::on_enqueue(1, overwritten, nelem, capacity());
+  return true;
+}
+
+
+/**
+@brief Accoda n valori presi da un array
+Accoda n valori in un colpo solo: la scrittura è divisa in al più due tratti
+contigui attorno alla fine dell'array (memcpy se T è banalmente copiabile).
+Come per enqueue, se non c'è spazio decide la politica di overflow: di default
+vengono sovrascritti gli elementi più vecchi, con reject_new si accodano solo
+i valori che entrano. I valori possono stare nel cbuffer stesso: in quel caso
+vengono prima copiati in un array di appoggio.
+@param src indirizzo del primo valore da accodare
+@param n numero di valori da accodare
+@return numero di valori accodati (n, o quelli che entravano con reject_new)
+**/
+
+size_type enqueue_n(const T *src, size_type n){
+  return enqueue_range(src, n);
+}
+
+/**
+@brief Accoda i valori della sequenza [begin, end)
+Con iteratori almeno forward la sequenza viene scritta a tratti contigui
+come in enqueue_n(const T*, size_type), altrimenti elemento per elemento.
+Come per enqueue_n(const T*, size_type) la sequenza può essere presa dal
+cbuffer stesso (puntatori o iteratori del cbuffer).
+@param begin iteratore inizio sequenza dati
+@param end iteratore fine sequenza dati
+@return numero di valori accodati
+**/
+
+template <typename I>
+size_type enqueue_n(I begin, I end){
+  typedef typename std::iterator_traits<I>::iterator_category category;
+  if constexpr (std::is_pointer<I>::value &&
+                std::is_same<typename std::remove_cv<typename std::remove_pointer<I>::type>::type, T>::value) {
+    return enqueue_range(static_cast<const T*>(begin), static_cast<size_type>(end - begin));
+  }
+  else if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+    return enqueue_range(begin, static_cast<size_type>(std::distance(begin, end)));
+  }
+  else {
+    size_type n = 0;
+    for(; begin != end; ++begin)
+      n += emplace(*begin);
+    return n;
+  }
+}
+
+/**
+@brief Toglie dalla testa fino a n elementi copiandoli in out
+Gli elementi vengono spostati in out (memcpy se T è banalmente copiabile)
+al più in due tratti contigui e gli indici vengono aggiornati una volta sola.
+@param out array di destinazione (almeno n elementi già costruiti)
+@param n numero massimo di elementi da togliere
+@return numero di elementi tolti (min(n, countelem()))
+**/
+
+size_type dequeue_n(T *out, size_type n){
+  size_type m = std::min(n, nelem);
+  size_type n1 = std::min(m, first_segment());
+  T *buf = _storage.data();
+  if constexpr (std::is_trivially_copyable<T>::value) {
+    if(n1 != 0)
+      std::memcpy(out, buf + first, n1 * sizeof(T));
+    if(m != n1)
+      std::memcpy(out + n1, buf, (m - n1) * sizeof(T));
+  }
+  else {
+    std::move(buf + first, buf + first + n1, out);
+    std::move(buf, buf + (m - n1), out + n1);
+  }
+  drop_front(m);
+  Stats::on_pop(m, nelem, capacity());
+  return m;
+}
+
+/**
+@brief Primo tratto contiguo degli elementi presenti (da first alla fine dell'array)
+Insieme ad array_two descrive tutto il contenuto senza copie, ad esempio
+per passarlo a writev.
+@return coppia (puntatore, lunghezza), lunghezza 0 se il buffer è vuoto
+**/
+
+array_range array_one(){
+  return array_range(_storage.data() + first, first_segment());
+}
+
+const_array_range array_one() const{
+  return const_array_range(_storage.data() + first, first_segment());
+}
+
+/**
+@brief Secondo tratto contiguo degli elementi presenti (dall'inizio dell'array)
+@return coppia (puntatore, lunghezza), lunghezza 0 se il contenuto non fa il giro
+**/
+
+array_range array_two(){
+  return array_range(_storage.data(), nelem - first_segment());
+}
+
+const_array_range array_two() const{
+  return const_array_range(_storage.data(), nelem - first_segment());
+}
+
+/**
+@brief Primo tratto contiguo di celle libere (dalla coda alla fine dell'array)
+Le celle libere possono essere riempite direttamente (ad esempio con recv o readv)
+e poi rese visibili con commit_write. Disponibile solo per T banalmente copiabile.
+@return coppia (puntatore, lunghezza), lunghezza 0 se il buffer è pieno
+**/
+
+array_range write_array_one(){
+  static_assert(std::is_trivially_copyable<T>::value,
+                "write_array_one richiede T banalmente copiabile");
+  size_type tail = _storage.wrap(first + nelem);
+  return array_range(_storage.data() + tail, std::min(capacity() - nelem, capacity() - tail));
+}
+
+/**
+@brief Secondo tratto contiguo di celle libere (dall'inizio dell'array)
+@return coppia (puntatore, lunghezza), lunghezza 0 se le celle libere non fanno il giro
+**/
+
+array_range write_array_two(){
+  static_assert(std::is_trivially_copyable<T>::value,
+                "write_array_two richiede T banalmente copiabile");
+  size_type tail = _storage.wrap(first + nelem);
+  size_type free = capacity() - nelem;
+  return array_range(_storage.data(), free - std::min(free, capacity() - tail));
+}
+
+/**
+@brief Rende visibili n elementi scritti nelle celle libere
+@pre n <= capacity() - countelem(), le celle sono state scritte nell'ordine
+di write_array_one e write_array_two
+@param n numero di elementi scritti
+**/
+
+void commit_write(size_type n){
+  static_assert(std::is_trivially_copyable<T>::value,
+                "commit_write richiede T banalmente copiabile");
+  assert(n <= capacity() - nelem);
+  nelem += n;
+  sync();
+  Stats::on_enqueue(n, 0, nelem, capacity());
+}
+
+/**
+@brief Toglie dalla testa n elementi con un solo aggiornamento degli indici
+Da usare dopo aver letto i dati con array_one/array_two (ad esempio dopo writev).
+@pre n <= countelem()
+@param n numero di elementi da togliere
+**/
+
+void consume(size_type n){
+  assert(n <= nelem);
+  drop_front(n);
+  Stats::on_pop(n, nelem, capacity());
+}
+
+/**
+@brief Elabora sul posto fino a n elementi dalla testa e li toglie
+f viene chiamata con (T*, size_type) su ciascun tratto contiguo, al più
+due volte e in ordine logico; alla fine gli elementi elaborati vengono
+tolti con un solo aggiornamento degli indici. Il valore ritornato da f
+decide quanto consumare:
+- void: tutto il tratto;
+- bool: tutto il tratto, false ferma l'elaborazione;
+- intero k <= lunghezza: i primi k elementi, k minore della lunghezza ferma l'elaborazione.
+Se f lancia, gli elementi dei tratti già completati vengono tolti comunque.
+Dentro f il cbuffer non va modificato.
+@param n numero massimo di elementi da elaborare
+@param f funtore chiamato come f(T*, size_type)
+@return numero di elementi tolti
+**/
+
+template <typename F>
+size_type consume_up_to(size_type n, F f){
+  size_type m = std::min(n, nelem);
+  size_type n1 = std::min(m, first_segment());
+  size_type done = 0;
+  try {
+    if(n1 != 0 && consume_segment(f, _storage.data() + first, n1, done) && m != n1)
+      consume_segment(f, _storage.data(), m - n1, done);
   }
-  else if(((last >= first && last < (_size-1)) && !isEmpty())|| (first > last)){  //buffer ancora da riempire(lineare)
-    last = last + 1;
-    _buffer[last] = value;
-    freespace--;
+  catch(...) {
+    consume(done);
+    throw;
   }
-  else if((last == (_size - 1)) && first == 0){ //aggiunta elemento buffer pieno (circolare)
-    last = 0;
-    first = 1;
-    _buffer[last] = value;
+  consume(done);
+  return done;
+}
+
+/**
+@brief Elabora sul posto tutti gli elementi e li toglie (vedi consume_up_to)
+@param f funtore chiamato come f(T*, size_type)
+@return numero di elementi tolti
+**/
+
+template <typename F>
+size_type drain(F f){
+  return consume_up_to(nelem, f);
+}
+
+/**
+@brief Accesso in lettura alla politica di memorizzazione
+**/
+
+const Storage &storage() const{
+  return _storage;
+}
+
+/**
+@brief Accesso in lettura ai contatori della politica delle statistiche
+Con counting_stats il riferimento può essere passato a un thread di
+monitoraggio, che legge i contatori mentre il cbuffer viene usato.
+**/
+
+const Stats &stats() const{
+  return *this;
+}
+
+/**
+@brief Accesso alla politica di overflow (ad esempio per impostare spill_oldest::spill)
+**/
+
+Overflow &overflow(){
+  return *this;
+}
+
+const Overflow &overflow() const{
+  return *this;
+}
+
+/**
+@brief Ritorna se gli elementi presenti sono già contigui in memoria
+Vero se il contenuto non fa il giro dell'array oppure se la politica di
+memorizzazione mappa l'array due volte di seguito (vmring_storage).
+**/
+
+bool is_linearized() const{
+  return _storage.mirrored() || first_segment() == nelem;
+}
+
+/**
+@brief Rende contigui gli elementi presenti
+Con vmring_storage l'array è seguito dalla sua copia mappata, quindi
+basta ritornare l'indirizzo di first; altrimenti, se il contenuto fa il
+giro dell'array, gli elementi vengono riportati a partire dalla cella 0.
+Per T banalmente copiabile il tratto più corto passa da un appoggio e
+l'altro viene spostato con memmove: si toccano solo le celle occupate.
+Altrimenti gli elementi vengono ricollocati in un nuovo array della
+stessa capacità, con lo stesso allocatore.
+@return puntatore al primo di countelem() elementi contigui
+**/
+
+T *linearize(){
+  if(is_linearized())
+    return _storage.data() + first;
+  if constexpr (std::is_trivially_copyable<T>::value) {
+    // [secondo tratto, celle libere, primo tratto] -> [primo, secondo, libere]
+    T *buf = _storage.data();
+    size_type n1 = first_segment();
+    size_type n2 = nelem - n1;
+    T *tmp = cbuffer_detail::allocate_raw<T>(std::min(n1, n2));
+    if(n2 <= n1) {
+      std::memcpy(tmp, buf, n2 * sizeof(T));
+      std::memmove(buf, buf + first, n1 * sizeof(T));
+      std::memcpy(buf + n1, tmp, n2 * sizeof(T));
+    }
+    else {
+      std::memcpy(tmp, buf + first, n1 * sizeof(T));
+      std::memmove(buf + n1, buf, n2 * sizeof(T));
+      std::memcpy(buf, tmp, n1 * sizeof(T));
+    }
+    cbuffer_detail::deallocate_raw(tmp);
+    first = 0;
+    sync();
   }
-  else if(last == (_size - 1)) //buffer non pieno (inizio non in posizione 0)(circolare)
-  {
-    last = 0;
-    _buffer[last] = value;
-    freespace--;
+  else if constexpr (Storage::growable)
+    relocate(capacity());
+  else {
+    // inline_storage: nessun allocatore da conservare
+    cbuffer tmp(capacity());
+    move_all(*this, tmp);
+    destroy_all();
+    move_all(tmp, *this);
   }
-  else{   //primo elemento inserito nell'array
-    _buffer[last] = value;
-    freespace--;
+  return _storage.data();
+}
+
+/**
+@brief Porta la capacità ad almeno n celle
+Se n è maggiore della capacità attuale gli elementi vengono spostati (non
+copiati, se T si sposta senza eccezioni) in un nuovo array, in ordine logico
+a partire dalla cella 0. Altrimenti non fa nulla.
+@param n numero minimo di celle
+**/
+
+void reserve(size_type n){
+  if(n > capacity())
+    relocate(n);
+}
+
+/**
+@brief Cambia la capacità in n celle
+Se gli elementi presenti sono più della nuova capacità vengono tolti i più
+vecchi (contati tra i drops di counting_stats). Gli elementi rimasti
+vengono spostati nel nuovo array a partire dalla cella 0. Se la nuova
+capacità coincide con quella attuale non si rialloca nulla.
+@param n nuova capacità (con pow2_storage arrotondata alla potenza di due)
+**/
+
+void resize(size_type n){
+  size_type cap = cbuffer_detail::storage_capacity<Storage>(n);
+  if(nelem > cap) {
+    size_type dropped = nelem - cap;
+    drop_front(dropped);
+    Stats::on_drop(dropped, nelem, capacity());
   }
+  if(cap != capacity())
+    relocate(cap);
 }
 
+/**
+@brief Riduce la capacità al numero di elementi presenti (almeno una cella)
+**/
+
+void shrink_to_fit(){
+  size_type n = std::max<size_type>(nelem, 1);
+  if(cbuffer_detail::storage_capacity<Storage>(n) < capacity())
+    relocate(n);
+}
 
 /**
 @brief Metodo che conta i valori contenuti in cbuffer
@@ -243,22 +1262,30 @@ Funzione che conta i valori contenuti in cbuffer
 **/
 
 size_type countelem() const{
-  return _size - freespace;
+  return nelem;
 }
 
 /**
-@brief Funzione che toglie la testa da cbuffer(logicamente)
-Funzione che toglie la testa da cbuffer(logicamente)
+@brief Funzione che toglie la testa da cbuffer
+Funzione che toglie la testa da cbuffer e ne distrugge l'elemento
 **/
 
 bool pop(){
-  assert(!isEmpty()); //non posso applicare pop a code con un solo elemento!
-  if(first == last)
-    freespace = _size;
-  else{
-    first = (first + 1)%_size;
-    freespace++;
-  }
+  assert(!isEmpty());
+  drop_front(1);
+  Stats::on_pop(1, nelem, capacity());
+  return true;
+}
+
+/**
+@brief Svuota il cbuffer distruggendo tutti gli elementi
+**/
+
+void clear(){
+  size_type dropped = nelem;
+  destroy_all();
+  if(dropped != 0)
+    Stats::on_drop(dropped, 0, capacity());
 }
 
 /**
@@ -266,27 +1293,13 @@ bool pop(){
 e restituisce se sono uguali
 Funzione che confronta cbuffer chiamante con quella passata
 e restituisce se sono uguali
+A differenza di operator== richiede anche la stessa capacità.
 @param CB da controllare
 @return risultato confronto
 **/
 
-bool equals(const cbuffer<T> &CB){
-    bool equal = true;
-    if(_size != CB._size)
-      return false;
-    typename cbuffer<T>::const_iterator i1=begin(), ie1=end(), i2 = CB.begin(), ie2 = CB.end();
-    while(equal){
-      if((i1 == ie1 && i2 != ie2) || (i1 != ie1 && i2 == ie2)) //uno dei due buffer ha finito ma l'altro no
-         return false;
-       else if (i1 == ie1 && i2 == ie2) //hanno entrambi finito e elementi =
-         return true;
-       else if(*i1 != *i2)  //elementi diversi
-         return  false;
-      else{      //elementi uguali
-        ++i1;
-        ++i2;
-      }
-    }
+bool equals(const cbuffer &CB) const{
+  return capacity() == CB.capacity() && *this == CB;
 }
 
 /**
@@ -301,7 +1314,7 @@ Metodo getter per leggere il valore index-esimo dell'array.
 
 T &operator[](size_type index) {
   assert(index < (countelem())); // asserzione se viene violata il programma termina
-  return _buffer[((first+index)%_size)];
+  return _storage.data()[_storage.wrap(first + index)];
 }
 
 /**
@@ -313,7 +1326,7 @@ Metodo setter per scrivere il valore index-esimo dell'array.
 
 const T &operator[](size_type index) const {
   assert(index < (countelem())); // asserzione (l'indice sfora la dimensione impostata del buffer)
-  return _buffer[((first+index)%_size)];
+  return _storage.data()[_storage.wrap(first + index)];
 }
 
 /**
@@ -323,144 +1336,215 @@ Scambia il contenuto di due cbuffer.
 **/
 
 void swap(cbuffer &other) {
-  std::swap(other._size, this->_size);
-  std::swap(other._buffer, this->_buffer);
-  std::swap(other.first, this->first);
-  std::swap(other.last, this->last);
-  std::swap(other.freespace, this->freespace);
+  if constexpr (Storage::pointer_swap) {
+    _storage.swap(other._storage);
+    std::swap(other.first, this->first);
+    std::swap(other.nelem, this->nelem);
+    sync();
+    other.sync();
+    swap_policies(other);
+  }
+  else if(this != &other) {
+    // celle contenute nell'oggetto: gli elementi vengono spostati uno per uno
+    cbuffer tmp;
+    move_all(*this, tmp);
+    move_all(other, *this);
+    move_all(tmp, other);
+    swap_policies(other);
+  }
 }
 
 class const_iterator;
 
+/**
+Iteratore ad accesso casuale. Oltre al puntatore alla cella tiene la
+posizione logica (0 = elemento più vecchio): confronti e distanze usano solo
+quella, l'incremento controlla il ritorno a capo con un solo confronto.
+**/
 class iterator {
   T *ptr;
   T *firstelem;
   size_type sizec;
-  int pos;
+  std::ptrdiff_t pos;
 
 public:
-  typedef std::forward_iterator_tag iterator_category;
-  typedef T                         value_type;
-  typedef ptrdiff_t                 difference_type;
-  typedef T*                        pointer;
-  typedef T&                        reference;
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef T                               value_type;
+  typedef std::ptrdiff_t                  difference_type;
+  typedef T*                              pointer;
+  typedef T&                              reference;
 
-  iterator() : ptr(0), sizec(0), firstelem(0), pos(0) {
+  iterator() : ptr(0), firstelem(0), sizec(0), pos(0) {
   }
 
-  iterator(const iterator &other) : ptr(other.ptr), sizec(other.sizec), firstelem(other.firstelem) {
+  iterator(const iterator &other)
+  : ptr(other.ptr), firstelem(other.firstelem), sizec(other.sizec), pos(other.pos) {
   }
 
-
   //operatore di assegnamento
   iterator& operator=(const iterator &other) {
     ptr = other.ptr;
-    sizec = other.sizec;
     firstelem = other.firstelem;
+    sizec = other.sizec;
     pos = other.pos;
     return *this;
   }
 
+  ~iterator() {}
 
+  // Ritorna il dato riferito dall'iteratore (dereferenziamento)
+  reference operator*() const {
+    return *ptr;
+  }
 
-  ~iterator() {}
+  // Ritorna il puntatore al dato riferito dall'iteratore
+  pointer operator->() const {
+    return ptr;
+  }
+
+  // Accesso all'elemento a distanza n
+  reference operator[](difference_type n) const {
+    return *(*this + n);
+  }
+
+  // Operatore di iterazione post-incremento
+  iterator operator++(int) {
+    iterator tmp(*this);
+    ++*this;
+    return tmp;
+  }
+
+  // Operatore di iterazione pre-incremento
+  iterator& operator++() {
+    ++pos;
+    if(++ptr == firstelem + sizec) //fine fisica dell'array: si torna all'inizio
+      ptr = firstelem;
+    return *this;
+  }
+
+  // Operatore di iterazione post-decremento
+  iterator operator--(int) {
+    iterator tmp(*this);
+    --*this;
+    return tmp;
+  }
+
+  // Operatore di iterazione pre-decremento
+  iterator& operator--() {
+    --pos;
+    if(ptr == firstelem)
+      ptr = firstelem + sizec;
+    --ptr;
+    return *this;
+  }
+
+  // Avanzamento di n posizioni in tempo costante
+  iterator& operator+=(difference_type n) {
+    ptr = firstelem + cbuffer::offset(ptr - firstelem, n, sizec);
+    pos += n;
+    return *this;
+  }
+
+  iterator& operator-=(difference_type n) {
+    return *this += -n;
+  }
 
-  // Ritorna il dato riferito dall'iteratore (dereferenziamento)
-  reference operator*() const {
-    return *ptr;
+  iterator operator+(difference_type n) const {
+    iterator tmp(*this);
+    return tmp += n;
   }
 
-  // Ritorna il puntatore al dato riferito dall'iteratore
-  pointer operator->() const {
-    return ptr;
+  friend iterator operator+(difference_type n, const iterator &it) {
+    return it + n;
   }
 
-  // Operatore di iterazione post-incremento
-  iterator operator++(int) {
-    const_iterator tmp(*this);
-    ++ptr;
-    ++pos;
-    if(const_iterator(ptr, sizec, firstelem, pos)  == const_iterator(firstelem + sizec, sizec, firstelem, pos)){ //se arrivo a end
-      if(pos != sizec)  //caso end fisica != end logica
-        tmp.ptr = firstelem;
-      }
-    return tmp;
+  iterator operator-(difference_type n) const {
+    iterator tmp(*this);
+    return tmp += -n;
   }
 
-  // Operatore di iterazione pre-incremento
-  iterator& operator++() {
-    ++ptr;
-    pos++;
-    if(iterator(ptr, sizec, firstelem, pos)  == iterator(firstelem + sizec, sizec, firstelem, pos)){ //se arrivo a end
-      if(pos != sizec) //caso end fisica != end logica
-       ptr = firstelem;
-    }
-    return *this;
+  // Distanza tra due iteratori dello stesso cbuffer
+  difference_type operator-(const iterator &other) const {
+    return pos - other.pos;
   }
 
   // Uguaglianza
   bool operator==(const iterator &other) const {
-    return (ptr == other.ptr && firstelem == other.firstelem && sizec == other.sizec && pos == other.pos);
-
+    return pos == other.pos;
   }
 
   // Diversita'
   bool operator!=(const iterator &other) const {
-    return (ptr != other.ptr ||  firstelem != other.firstelem || sizec != other.sizec || pos != other.pos);
+    return pos != other.pos;
+  }
+
+  bool operator<(const iterator &other) const {
+    return pos < other.pos;
+  }
+
+  bool operator>(const iterator &other) const {
+    return pos > other.pos;
+  }
+
+  bool operator<=(const iterator &other) const {
+    return pos <= other.pos;
+  }
+
+  bool operator>=(const iterator &other) const {
+    return pos >= other.pos;
   }
 
   //Funzione getter che restituisce la posizione logica del'iteratore nell'array
   int getPos() const {
-    return pos;
+    return static_cast<int>(pos);
   }
 
   friend class const_iterator;
 
   // Uguaglianza
   bool operator==(const const_iterator &other) const {
-    return (ptr == other.ptr && firstelem == other.firstelem && sizec == other.sizec && pos == other.pos);
+    return pos == other.pos;
   }
 
   // Diversita'
   bool operator!=(const const_iterator &other) const {
-    return (ptr != other.ptr ||  firstelem != other.firstelem || sizec != other.sizec || pos != other.pos);
+    return pos != other.pos;
   }
 
 private:
   friend class cbuffer;
 
-  iterator(T*p, size_type sizecb, T*fe, int posc) : ptr(p), sizec(sizecb), firstelem(fe),pos(posc) {
-
+  iterator(T*p, size_type sizecb, T*fe, difference_type posc) : ptr(p), firstelem(fe), sizec(sizecb), pos(posc) {
   }
 
-
 }; // classe iterator
 
+/**
+Iteratore costante ad accesso casuale (stessa struttura di iterator)
+**/
 class const_iterator {
   const T *ptr;
   const T *firstelem;
   size_type sizec;
-  int pos;
+  std::ptrdiff_t pos;
 
 public:
-  typedef std::forward_iterator_tag iterator_category;
-  typedef T                         value_type;
-  typedef ptrdiff_t                 difference_type;
-  typedef const T*                  pointer;
-  typedef const T&                  reference;
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef T                               value_type;
+  typedef std::ptrdiff_t                  difference_type;
+  typedef const T*                        pointer;
+  typedef const T&                        reference;
 
 
-  const_iterator() : ptr(0), sizec(0), firstelem(0), pos(0) {
+  const_iterator() : ptr(0), firstelem(0), sizec(0), pos(0) {
   }
 
   const_iterator(const const_iterator &other)
   : ptr(other.ptr), firstelem(other.firstelem), sizec(other.sizec), pos(other.pos) {
-
   }
 
   const_iterator(const iterator &other)
   : ptr(other.ptr), firstelem(other.firstelem), sizec(other.sizec), pos(other.pos)  {
-
   }
 
   const_iterator& operator=(const const_iterator &other) {
@@ -475,6 +1559,7 @@ public:
     ptr = other.ptr;
     firstelem = other.firstelem;
     sizec = other.sizec;
+    pos = other.pos;
     return *this;
   }
 
@@ -491,130 +1576,817 @@ public:
     return ptr;
   }
 
+  // Accesso all'elemento a distanza n
+  reference operator[](difference_type n) const {
+    return *(*this + n);
+  }
+
   // Operatore di iterazione post-incremento
   const_iterator operator++(int) {
     const_iterator tmp(*this);
-    ++ptr;
-    ++pos;
-    if(const_iterator(ptr, sizec, firstelem, pos)  == const_iterator(firstelem + sizec, sizec, firstelem, pos)){
-      if(pos != sizec)
-        tmp.ptr = firstelem;
-      }
+    ++*this;
     return tmp;
   }
 
   // Operatore di iterazione pre-incremento
   const_iterator& operator++() {
-    ++ptr;
     ++pos;
-    if(const_iterator(ptr, sizec, firstelem, pos)  == const_iterator(firstelem + sizec, sizec, firstelem, pos)){   //se arrivo a end
-      if(pos != sizec)  //caso  end fisica != end logica
-        ptr = firstelem;
-      }
+    if(++ptr == firstelem + sizec) //fine fisica dell'array: si torna all'inizio
+      ptr = firstelem;
+    return *this;
+  }
+
+  // Operatore di iterazione post-decremento
+  const_iterator operator--(int) {
+    const_iterator tmp(*this);
+    --*this;
+    return tmp;
+  }
+
+  // Operatore di iterazione pre-decremento
+  const_iterator& operator--() {
+    --pos;
+    if(ptr == firstelem)
+      ptr = firstelem + sizec;
+    --ptr;
+    return *this;
+  }
+
+  // Avanzamento di n posizioni in tempo costante
+  const_iterator& operator+=(difference_type n) {
+    ptr = firstelem + cbuffer::offset(ptr - firstelem, n, sizec);
+    pos += n;
     return *this;
   }
 
+  const_iterator& operator-=(difference_type n) {
+    return *this += -n;
+  }
+
+  const_iterator operator+(difference_type n) const {
+    const_iterator tmp(*this);
+    return tmp += n;
+  }
+
+  friend const_iterator operator+(difference_type n, const const_iterator &it) {
+    return it + n;
+  }
+
+  const_iterator operator-(difference_type n) const {
+    const_iterator tmp(*this);
+    return tmp += -n;
+  }
+
+  // Distanza tra due iteratori dello stesso cbuffer
+  difference_type operator-(const const_iterator &other) const {
+    return pos - other.pos;
+  }
+
   // Uguaglianza
   bool operator==(const const_iterator &other) const {
-    return (ptr == other.ptr && firstelem == other.firstelem && sizec == other.sizec && pos == other.pos);
-
+    return pos == other.pos;
   }
+
   // Diversita'
   bool operator!=(const const_iterator &other) const {
-    return (ptr != other.ptr ||  firstelem != other.firstelem || sizec != other.sizec || pos != other.pos);
+    return pos != other.pos;
   }
 
-  friend class iterator;
+  bool operator<(const const_iterator &other) const {
+    return pos < other.pos;
+  }
 
-  // Uguaglianza
-  bool operator==(const iterator &other) const {
-    return (ptr == other.ptr && firstelem == other.firstelem && sizec == other.sizec && pos == other.pos);
+  bool operator>(const const_iterator &other) const {
+    return pos > other.pos;
   }
 
-  // Diversita'
-  bool operator!=(const iterator &other) const {
-    return (ptr != other.ptr ||  firstelem != other.firstelem || _size != other.sizec || pos != other.pos);
+  bool operator<=(const const_iterator &other) const {
+    return pos <= other.pos;
   }
+
+  bool operator>=(const const_iterator &other) const {
+    return pos >= other.pos;
+  }
+
+  friend class iterator;
+
   //Funzione getter che restituisce la posizione logica del'iteratore nell'array
   int getPos() const {
-    return pos;
+    return static_cast<int>(pos);
   }
+
 private:
   friend class cbuffer;
 
   // Costruttore privato usabile da cbuffer
-  const_iterator(const T*p,const size_type sizecb, const T*fe, int posizione) : ptr(p), sizec(sizecb), firstelem(fe), pos(posizione) {
-
+  const_iterator(const T*p,const size_type sizecb, const T*fe, difference_type posizione) : ptr(p), firstelem(fe), sizec(sizecb), pos(posizione) {
   }
 
 }; // classe const_iterator
 
+typedef std::reverse_iterator<iterator> reverse_iterator;
+typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
 // Ritorna l'iteratore all'first della sequenza dati
 iterator begin() {
-  return iterator(_buffer + first, _size, _buffer,0);
+  return iterator(_storage.data() + first, capacity(), _storage.data(), 0);
 }
 
 // Ritorna l'iteratore alla last della sequenza dati
 iterator end() {
-  return iterator(_buffer + last + 1, _size, _buffer,countelem());
+  return iterator(_storage.data() + _storage.wrap(first + nelem), capacity(), _storage.data(), countelem());
 }
 
 
 //Ritorna l'iteratore costante a first della sequenza dati
 const_iterator begin() const {
-  return const_iterator(_buffer + first, _size, _buffer,0);
+  return const_iterator(_storage.data() + first, capacity(), _storage.data(), 0);
 }
 
 // Ritorna l'iteratore costante a last della sequenza dati
 const_iterator end() const {
-  return const_iterator(_buffer + last + 1,_size, _buffer,countelem());
+  return const_iterator(_storage.data() + _storage.wrap(first + nelem), capacity(), _storage.data(), countelem());
+}
+
+// Iteratori inversi (dal più nuovo al più vecchio)
+reverse_iterator rbegin() {
+  return reverse_iterator(end());
+}
+
+reverse_iterator rend() {
+  return reverse_iterator(begin());
+}
+
+const_reverse_iterator rbegin() const {
+  return const_reverse_iterator(end());
+}
+
+const_reverse_iterator rend() const {
+  return const_reverse_iterator(begin());
+}
+
+/**
+@brief Applica f a ciascun tratto contiguo degli elementi presenti
+Aggancio per gli algoritmi segmentati: f viene chiamata con (puntatore, lunghezza)
+al più due volte, in ordine logico, così il ciclo interno lavora su memoria contigua.
+@param f funtore chiamato come f(T*, size_type)
+**/
+
+template <typename F>
+void for_each_segment(F f) {
+  size_type n1 = first_segment();
+  if(n1 != 0)
+    f(_storage.data() + first, n1);
+  if(nelem != n1)
+    f(_storage.data(), nelem - n1);
+}
+
+template <typename F>
+void for_each_segment(F f) const {
+  size_type n1 = first_segment();
+  if(n1 != 0)
+    f(static_cast<const T*>(_storage.data() + first), n1);
+  if(nelem != n1)
+    f(static_cast<const T*>(_storage.data()), nelem - n1);
 }
 
 
 private:
 
-  T *_buffer; ///< Puntatore al buffer
-  size_type _size; ///< Dimensione dell'array
+  // Comunica lo stato degli indici alla politica di memorizzazione
+  // (vuota tranne che per mmap_storage, dove scrive l'intestazione del file)
+  void sync() {
+    _storage.store_state(first, nelem);
+  }
+
+  // Lo spostamento non lancia se cede il puntatore o se T si sposta senza eccezioni
+  static const bool nothrow_relocate = Storage::pointer_swap ||
+    std::is_nothrow_move_constructible<T>::value;
+
+  // Sostituisce l'array con uno di n celle (n >= nelem) spostandovi gli
+  // elementi in ordine logico a partire dalla cella 0. Se una costruzione
+  // lancia, il nuovo array viene liberato e il cbuffer resta com'era
+  // (move_if_noexcept: se lo spostamento può lanciare si copia).
+  void relocate(size_type n) {
+    static_assert(Storage::growable, "la politica di memorizzazione non permette di cambiare capacità");
+    assert(n >= nelem);
+    Storage fresh(cbuffer_detail::storage_like(_storage, n));
+    T *dst = fresh.data();
+    T *buf = _storage.data();
+    size_type n1 = first_segment();
+    size_type count = nelem;
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      if(n1 != 0)
+        std::memcpy(dst, buf + first, n1 * sizeof(T));
+      if(count != n1)
+        std::memcpy(dst + n1, buf, (count - n1) * sizeof(T));
+    }
+    else {
+      size_type i = 0;
+      try {
+        for(; i < count; ++i)
+          ::new (static_cast<void*>(dst + i)) T(std::move_if_noexcept(buf[_storage.wrap(first + i)]));
+      }
+      catch(...) {
+        for(size_type j = 0; j < i; ++j)
+          dst[j].~T();
+        throw;
+      }
+      drop_front(count);
+    }
+    _storage.swap(fresh);
+    first = 0;
+    nelem = count;
+    sync();
+  }
+
+  // Scambia le politiche di overflow (le statistiche restano all'oggetto)
+  void swap_policies(cbuffer &other) {
+    using std::swap;
+    swap(overflow(), other.overflow());
+  }
+
+  // Costruisce un elemento in coda senza aggiornare le statistiche.
+  // Se il buffer è pieno l'elemento più vecchio viene distrutto e sovrascritto
+  // (per T non banalmente distruttibile il valore viene costruito prima: args
+  // può riferirsi proprio all'elemento più vecchio); per T banalmente
+  // distruttibile gli indici vengono aggiornati senza salti condizionati.
+  // Ritorna 1 se un elemento è stato sovrascritto.
+  template <typename... Args>
+  size_type emplace_back(Args&&... args) {
+    assert(capacity() != 0);
+    size_type overwritten = (nelem == capacity());
+    // Gli argomenti possono riferirsi alla cella sovrascritta (enqueue(c[0])):
+    // il nuovo valore si costruisce prima, tranne quando è la copia di un T
+    // banalmente copiabile, che equivale a una memcpy sulla cella stessa
+    if constexpr (!(std::is_trivially_copyable<T>::value && sizeof...(Args) == 1 &&
+                    (std::is_same<typename std::decay<Args>::type, T>::value && ...))) {
+      if(overwritten) {
+        T value(std::forward<Args>(args)...);
+        drop_front(1);
+        return emplace_back(std::move(value)) + 1;
+      }
+    }
+    ::new (static_cast<void*>(_storage.data() + _storage.wrap(first + nelem))) T(std::forward<Args>(args)...);
+    size_type full = (nelem == capacity());
+    first = _storage.wrap(first + full);
+    nelem += 1 - full;
+    sync();
+    return overwritten;
+  }
+
+  // Passa a f un tratto di len elementi e somma a done quelli da consumare
+  // secondo il tipo ritornato (vedi consume_up_to). Ritorna false se f chiede
+  // di fermarsi.
+  template <typename F>
+  static bool consume_segment(F &f, T *p, size_type len, size_type &done) {
+    typedef decltype(f(p, len)) result;
+    if constexpr (std::is_void<result>::value) {
+      f(p, len);
+      done += len;
+      return true;
+    }
+    else if constexpr (std::is_same<result, bool>::value) {
+      bool go = f(p, len);
+      done += len;
+      return go;
+    }
+    else {
+      size_type k = static_cast<size_type>(f(p, len));
+      assert(k <= len);
+      done += k;
+      return k == len;
+    }
+  }
+
+  // Numero di elementi nel primo tratto contiguo (da first alla fine dell'array)
+  size_type first_segment() const {
+    return std::min(nelem, capacity() - first);
+  }
+
+  // Copia in coda (this vuoto) gli elementi presenti in other, a partire dalla cella 0.
+  // Per T banalmente copiabile bastano al più due memcpy.
+  void copy_live(const cbuffer &other) {
+    assert(isEmpty() && capacity() >= other.countelem());
+    const T *src = other._storage.data();
+    size_type n1 = other.first_segment();
+    size_type n2 = other.nelem - n1;
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      if(n1 != 0)
+        std::memcpy(_storage.data(), src + other.first, n1 * sizeof(T));
+      if(n2 != 0)
+        std::memcpy(_storage.data() + n1, src, n2 * sizeof(T));
+      first = 0;
+      nelem = other.nelem;
+      sync();
+    }
+    else {
+      try {
+        for(size_type i = 0; i < n1; ++i)
+          emplace_back(src[other.first + i]);
+        for(size_type i = 0; i < n2; ++i)
+          emplace_back(src[i]);
+      }
+      catch(...) {
+        clear();
+        throw;
+      }
+    }
+  }
+
+  // Distrugge i primi n elementi con un solo aggiornamento degli indici
+  void drop_front(size_type n) {
+    assert(n <= nelem);
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+      T *buf = _storage.data();
+      size_type n1 = std::min(n, first_segment());
+      for(size_type i = 0; i < n1; ++i)
+        buf[first + i].~T();
+      for(size_type i = 0; i < n - n1; ++i)
+        buf[i].~T();
+    }
+    first = _storage.wrap(first + n);
+    nelem -= n;
+    sync();
+  }
+
+  // Distrugge tutti gli elementi e riporta la testa alla cella 0, senza
+  // passare da Stats: negli assegnamenti i vecchi elementi vengono
+  // sostituiti, non scartati
+  void destroy_all() {
+    drop_front(nelem);
+    first = 0;
+    sync();
+  }
+
+  // Costruisce n elementi consecutivi in dst leggendoli da src (che avanza).
+  // Se una costruzione lancia, gli elementi già costruiti vengono distrutti.
+  template <typename I>
+  static void construct_n(T *dst, I &src, size_type n) {
+    if constexpr (std::is_trivially_copyable<T>::value && std::is_same<I, const T*>::value) {
+      // la sorgente non sta nell'array (vedi enqueue_range)
+      if(n != 0)
+        std::memcpy(static_cast<void*>(dst), src, n * sizeof(T));
+      src += n;
+    }
+    else {
+      size_type i = 0;
+      try {
+        for(; i < n; ++i, ++src)
+          ::new (static_cast<void*>(dst + i)) T(*src);
+      }
+      catch(...) {
+        for(size_type j = 0; j < i; ++j)
+          dst[j].~T();
+        throw;
+      }
+    }
+  }
+
+  // Accoda n valori letti da src. Se n >= capacity() restano solo gli ultimi
+  // capacity() valori, altrimenti si fa posto togliendo i più vecchi e si
+  // scrive in al più due tratti contigui. Con reject_new si accodano solo i
+  // valori che entrano; con spill_oldest, se serve fare posto, si procede
+  // un valore alla volta così la politica riceve gli espulsi in ordine.
+  template <typename I>
+  size_type enqueue_range(I src, size_type n) {
+    if(aliases(src, n)) {
+      // la sorgente sta nell'array: fare posto o scrivere la sovrascriverebbe
+      std::vector<T> copy;
+      copy.reserve(n);
+      for(size_type i = 0; i < n; ++i, ++src)
+        copy.push_back(*src);
+      return enqueue_range(static_cast<const T*>(copy.data()), n);
+    }
+    if constexpr (Overflow::action == overflow_grow) {
+      if(nelem + n > capacity())
+        relocate(std::max(nelem + n, Overflow::next_capacity(capacity())));
+    }
+    assert(capacity() != 0);
+    size_type cap = capacity();
+    if constexpr (Overflow::action == overflow_spill) {
+      if(nelem + n > cap) {
+        for(size_type i = 0; i < n; ++i, ++src)
+          emplace(*src);
+        return n;
+      }
+    }
+    size_type accepted = n;
+    if constexpr (Overflow::action == overflow_reject)
+      accepted = std::min(n, cap - nelem);
+    size_type len = accepted;
+    size_type before = nelem;
+    if(len >= cap) {
+      drop_front(nelem);
+      first = 0;
+      std::advance(src, len - cap);
+      len = cap;
+    }
+    else if(nelem + len > cap)
+      drop_front(nelem + len - cap);
+    size_type tail = _storage.wrap(first + nelem);
+    size_type n1 = std::min(len, cap - tail);
+    construct_n(_storage.data() + tail, src, n1);
+    nelem += n1;
+    construct_n(_storage.data(), src, len - n1);
+    nelem += len - n1;
+    sync();
+    Stats::on_enqueue(accepted, before + accepted - nelem, nelem, cap);
+    if(accepted != n)
+      Stats::on_drop(n - accepted, nelem, cap);
+    return accepted;
+  }
+
+  // Ritorna se la sequenza di n valori da src sta nell'array di questo cbuffer
+  // (con vmring_storage anche nella seconda mappatura)
+  bool aliases(const T *src, size_type n) const {
+    const T *begin = _storage.data();
+    const T *end = begin + (_storage.mirrored() ? 2 * capacity() : capacity());
+    std::less<const T*> before;
+    return n != 0 && before(src, end) && before(begin, src + n);
+  }
+
+  bool aliases(const iterator &src, size_type n) const {
+    return n != 0 && src.firstelem == _storage.data();
+  }
+
+  bool aliases(const const_iterator &src, size_type n) const {
+    return n != 0 && src.firstelem == _storage.data();
+  }
+
+  // Iteratori inversi: la sequenza di n valori termina in base()
+  bool aliases(const reverse_iterator &src, size_type n) const {
+    return aliases(src.base(), n);
+  }
+
+  bool aliases(const const_reverse_iterator &src, size_type n) const {
+    return aliases(src.base(), n);
+  }
+
+  template <typename P>
+  bool aliases(const std::reverse_iterator<P*> &src, size_type n) const {
+    return aliases(static_cast<const T*>(src.base() - n), n);
+  }
+
+  template <typename I>
+  bool aliases(const I &, size_type) const {
+    return false;
+  }
+
+  // Sposta in coda a dst tutti gli elementi di src, lasciando src vuoto
+  static void move_all(cbuffer &src, cbuffer &dst) {
+    while(!src.isEmpty()) {
+      dst.emplace_back(std::move(src[0]));
+      src.drop_front(1);
+    }
+  }
+
+  // Offset fisico a distanza n da off, con |n| <= cap
+  static std::ptrdiff_t offset(std::ptrdiff_t off, std::ptrdiff_t n, size_type cap) {
+    off += n;
+    if(off >= static_cast<std::ptrdiff_t>(cap))
+      off -= cap;
+    else if(off < 0)
+      off += cap;
+    return off;
+  }
+
+  Storage _storage; ///< Array e aritmetica degli indici
   size_type first; ///< Posizione nell'array dell'elemento più vecchio
-  size_type last; ///< Posizione nell'array dell'elemento più nuovo
-  size_type freespace;///< N elementi mancanti a riempire il buffer
+  size_type nelem; ///< Numero di elementi contenuti
 };
 
+/**
+  cbuffer a capacità fissa N senza allocazioni. Ha la stessa interfaccia
+  di cbuffer<T>, quindi i due tipi sono intercambiabili con un typedef.
+*/
+
+template <typename T, unsigned int N>
+using fixed_cbuffer = cbuffer<T, inline_storage<T, N> >;
+
 /**
 	Ridefinizione dell'operatore di stream per la stampa
-	del cbuffer
+	del cbuffer: un elemento per riga, separati da '\n' così che
+	le righe si accumulino nel buffer dello stream, con un solo
+	flush alla fine. Un cbuffer vuoto non stampa nulla.
 
 	@param os oggetto stream di output
 	@param cbuff cbuffer da stampare
 	@return reference allo stream di output
 */
 
-template <typename T>
+template <typename T, typename... S>
 std::ostream &operator<<(std::ostream &os,
-	const cbuffer<T> &cbuff) {
-    assert(!cbuff.isEmpty());
-    typename cbuffer<T>::const_iterator i, ie;
-    for(i = cbuff.begin(), ie = cbuff.end(); i != ie;++i)
-  		os << *i << std::endl;
+	const cbuffer<T, S...> &cbuff) {
+  cbuff.for_each_segment([&os](const T *p, typename cbuffer<T, S...>::size_type n) {
+    for(typename cbuffer<T, S...>::size_type i = 0; i < n; ++i)
+      os << p[i] << '\n';
+  });
+  return os.flush();
+}
+
+namespace cbuffer_detail {
+
+// Intestazione del formato binario di serialize/deserialize
+struct serial_header {
+  std::uint64_t magic;
+  std::uint32_t elem_size;
+  std::uint32_t capacity;
+  std::uint32_t count;
+  std::uint32_t reserved;
+};
+
+static const std::uint64_t SERIAL_MAGIC = 0x3146425542434243ull; ///< "CBCBUBF1"
+
+} // namespace cbuffer_detail
+
+/**
+  Scrive il cbuffer in formato binario: un'intestazione (dimensione
+  dell'elemento, capacità, numero di elementi) seguita dai due tratti
+  contigui degli elementi presenti, scritti così come sono in memoria.
+  Il formato dipende dall'architettura (endianness, layout di T).
+
+	@param os stream di output (aperto in modalità binaria)
+	@param CB cbuffer da scrivere
+	@return reference allo stream di output
+*/
+
+template <typename T, typename... S>
+std::ostream &serialize(std::ostream &os, const cbuffer<T, S...> &CB){
+  static_assert(std::is_trivially_copyable<T>::value,
+                "serialize richiede T banalmente copiabile");
+  cbuffer_detail::serial_header h = {cbuffer_detail::SERIAL_MAGIC, sizeof(T), CB.capacity(), CB.countelem(), 0};
+  os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  CB.for_each_segment([&os](const T *p, typename cbuffer<T, S...>::size_type n) {
+    os.write(reinterpret_cast<const char*>(p), static_cast<std::streamsize>(n * sizeof(T)));
+  });
+  return os;
+}
+
+/**
+  Legge un cbuffer scritto da serialize. Gli elementi vengono letti
+  direttamente nelle celle del cbuffer, che al termine contiene solo
+  quelli letti. Se lo stream finisce prima il cbuffer resta vuoto e
+  lo stream è in stato di errore.
+
+	@param is stream di input (aperto in modalità binaria)
+	@param CB cbuffer di destinazione (capacità almeno quella degli elementi salvati)
+	@return reference allo stream di input
+	@throw std::runtime_error se i dati non sono di serialize o non sono compatibili con CB
+*/
+
+template <typename T, typename... S>
+std::istream &deserialize(std::istream &is, cbuffer<T, S...> &CB){
+  static_assert(std::is_trivially_copyable<T>::value,
+                "deserialize richiede T banalmente copiabile");
+  cbuffer_detail::serial_header h;
+  CB.clear();
+  if(!is.read(reinterpret_cast<char*>(&h), sizeof(h)))
+    return is;
+  if(h.magic != cbuffer_detail::SERIAL_MAGIC || h.elem_size != sizeof(T))
+    throw std::runtime_error("deserialize: formato non riconosciuto");
+  if(h.count > CB.capacity())
+    throw std::runtime_error("deserialize: capacità insufficiente");
+  typename cbuffer<T, S...>::array_range r = CB.write_array_one();   // dopo clear parte dalla cella 0
+  if(is.read(reinterpret_cast<char*>(r.first), static_cast<std::streamsize>(h.count * sizeof(T))))
+    CB.commit_write(h.count);
+  return is;
+}
+
+/**
+  Valuta un predicato unario su ogni elemento del cbuffer lavorando
+  per tratti contigui. Con i predicati di cbuffer_simd.h (less_than,
+  equal_to, ...) su int, float e double si usano i kernel AVX2 quando
+  la CPU li supporta.
+
+	@param CB cbuffer su cui applicare il predicato
+	@param pred predicato unario
+	@return maschera con il bit i a 1 se pred è vero sull'elemento CB[i]
+*/
+
+template <typename T, typename P, typename... S>
+cbuffer_bitmask evaluate_mask(const cbuffer<T, S...> &CB, P pred){
+  return cbuffer_detail::mask_segments(CB, pred);
+}
+
+/**
+  Conta gli elementi del cbuffer che soddisfano il predicato
+
+	@param CB cbuffer su cui applicare il predicato
+	@param pred predicato unario
+	@return numero di elementi per cui pred è vero
+*/
+
+template <typename T, typename P, typename... S>
+typename cbuffer<T, S...>::size_type count_if(const cbuffer<T, S...> &CB, P pred){
+  return cbuffer_detail::count_segments(CB, pred);
+}
+
+/**
+  Cerca il primo elemento del cbuffer che soddisfa il predicato.
+  La scansione si ferma al primo blocco che contiene un elemento valido.
+
+	@param CB cbuffer su cui applicare il predicato
+	@param pred predicato unario
+	@return posizione logica del primo elemento valido, CB.countelem() se non c'è
+*/
+
+template <typename T, typename P, typename... S>
+typename cbuffer<T, S...>::size_type find_if(const cbuffer<T, S...> &CB, P pred){
+  return cbuffer_detail::find_segments(CB, pred);
+}
+
+/**
+  Ritorna se almeno un elemento del cbuffer soddisfa il predicato
+
+	@param CB cbuffer su cui applicare il predicato
+	@param pred predicato unario
+*/
+
+template <typename T, typename P, typename... S>
+bool any_of(const cbuffer<T, S...> &CB, P pred){
+  return find_if(CB, pred) != CB.countelem();
 }
 
 /**
   Funzione globale che prende un cbuffer e un predicato unario
   e stampa il risultato della sua applicazione su ogni elemento
-  del cbuffer
+  del cbuffer (una riga per elemento, un solo flush alla fine)
 
 	@param CB cbuffer su cui applicare il predicato
 	@param functor funtore del predicata
 */
 
 
-template <typename T,typename fctr>
-void evaluate_if(const cbuffer<T> &CB,fctr functor){
-  typename cbuffer<T>::const_iterator i, ie;
-  for(i = CB.begin(), ie = CB.end(); i != ie;++i)
-    if( functor ( *i ))
-      std::cout<<"["<<i.getPos()<<"] : true"<<std::endl;
-    else
-      std::cout<<"["<<i.getPos()<<"] : false"<<std::endl;
+template <typename T, typename fctr, typename... S>
+void evaluate_if(const cbuffer<T, S...> &CB,fctr functor){
+  cbuffer_detail::print_segments(CB, functor);
+}
+/**
+  Copia il contenuto del cbuffer in out lavorando per tratti contigui
+  (equivalente a std::copy(CB.begin(), CB.end(), out) ma con due cicli
+  su memoria contigua)
+
+	@param CB cbuffer da copiare
+	@param out iteratore di output
+	@return iteratore di output dopo l'ultimo elemento scritto
+*/
+
+template <typename T, typename O, typename... S>
+O segmented_copy(const cbuffer<T, S...> &CB, O out){
+  CB.for_each_segment([&out](const T *p, typename cbuffer<T, S...>::size_type n) {
+    out = std::copy(p, p + n, out);
+  });
+  return out;
+}
+
+/**
+  Confronta il contenuto del cbuffer con la sequenza che inizia in first2
+  lavorando per tratti contigui (equivalente a std::equal(CB.begin(), CB.end(), first2))
+
+	@param CB cbuffer da confrontare
+	@param first2 iteratore inizio della seconda sequenza
+	@return true se gli elementi sono uguali
+*/
+
+template <typename T, typename I, typename... S>
+bool segmented_equal(const cbuffer<T, S...> &CB, I first2){
+  bool equal = true;
+  CB.for_each_segment([&](const T *p, typename cbuffer<T, S...>::size_type n) {
+    if(equal) {
+      equal = std::equal(p, p + n, first2);
+      std::advance(first2, n);
+    }
+  });
+  return equal;
+}
+namespace cbuffer_detail {
+
+// Scorre in parallelo i tratti contigui di due sequenze (al più due tratti
+// ciascuna) e chiama f(pa, pb, len) su pezzi allineati, fino alla fine della
+// più corta o finché f ritorna false. Ritorna false se f si è fermata.
+template <typename T, typename F>
+bool walk_segments(const std::pair<const T*, unsigned int> (&a)[2],
+                   const std::pair<const T*, unsigned int> (&b)[2], F f) {
+  unsigned int ia = 0, ib = 0, oa = 0, ob = 0;
+  while(ia < 2 && ib < 2) {
+    if(oa == a[ia].second) {
+      ++ia;
+      oa = 0;
+      continue;
+    }
+    if(ob == b[ib].second) {
+      ++ib;
+      ob = 0;
+      continue;
+    }
+    unsigned int len = std::min(a[ia].second - oa, b[ib].second - ob);
+    if(!f(a[ia].first + oa, b[ib].first + ob, len))
+      return false;
+    oa += len;
+    ob += len;
+  }
+  return true;
+}
+
+// Confronto di len elementi contigui: memcmp se T non ha byte di riempimento
+// né valori diversi con la stessa rappresentazione, altrimenti std::equal
+template <typename T>
+bool equal_span(const T *a, const T *b, unsigned int len) {
+  if constexpr (std::has_unique_object_representations<T>::value)
+    return std::memcmp(a, b, len * sizeof(T)) == 0;
+  else
+    return std::equal(a, a + len, b);
+}
+
+} // namespace cbuffer_detail
+
+/**
+  Confronto degli elementi presenti (la capacità non conta). Esce subito se
+  il numero di elementi è diverso, poi confronta i tratti contigui a pezzi
+  allineati con memcmp (T con rappresentazione unica) o std::equal.
+
+	@param a primo cbuffer
+	@param b secondo cbuffer
+	@return true se contengono gli stessi elementi nello stesso ordine
+*/
+
+template <typename T, typename... S>
+bool operator==(const cbuffer<T, S...> &a, const cbuffer<T, S...> &b){
+  if(a.countelem() != b.countelem())
+    return false;
+  if(&a == &b)
+    return true;
+  typename cbuffer<T, S...>::const_array_range sa[2] = {a.array_one(), a.array_two()};
+  typename cbuffer<T, S...>::const_array_range sb[2] = {b.array_one(), b.array_two()};
+  return cbuffer_detail::walk_segments(sa, sb, &cbuffer_detail::equal_span<T>);
+}
+
+template <typename T, typename... S>
+bool operator!=(const cbuffer<T, S...> &a, const cbuffer<T, S...> &b){
+  return !(a == b);
+}
+
+/**
+  Confronto lessicografico degli elementi presenti (come <=> di C++20).
+  I pezzi allineati uguali vengono saltati con memcmp quando T ha
+  rappresentazione unica; solo nel pezzo che differisce si cerca il primo
+  elemento diverso.
+
+	@param a primo cbuffer
+	@param b secondo cbuffer
+	@return valore negativo, zero o positivo se a è minore, uguale o maggiore di b
+*/
+
+template <typename T, typename... S>
+int compare(const cbuffer<T, S...> &a, const cbuffer<T, S...> &b){
+  int result = 0;
+  typename cbuffer<T, S...>::const_array_range sa[2] = {a.array_one(), a.array_two()};
+  typename cbuffer<T, S...>::const_array_range sb[2] = {b.array_one(), b.array_two()};
+  cbuffer_detail::walk_segments(sa, sb, [&result](const T *pa, const T *pb, unsigned int len) {
+    if constexpr (std::has_unique_object_representations<T>::value) {
+      if(std::memcmp(pa, pb, len * sizeof(T)) == 0)
+        return true;
+    }
+    // coppie diverse ma non ordinate (ad esempio NaN) non decidono: si prosegue
+    const T *ea = pa + len;
+    while(pa != ea) {
+      std::pair<const T*, const T*> m = std::mismatch(pa, ea, pb);
+      if(m.first == ea)
+        return true;
+      if(*m.first < *m.second)
+        result = -1;
+      else if(*m.second < *m.first)
+        result = 1;
+      if(result != 0)
+        return false;
+      pa = m.first + 1;
+      pb = m.second + 1;
+    }
+    return true;
+  });
+  if(result == 0 && a.countelem() != b.countelem())
+    result = a.countelem() < b.countelem() ? -1 : 1;
+  return result;
+}
+
+template <typename T, typename... S>
+bool operator<(const cbuffer<T, S...> &a, const cbuffer<T, S...> &b){
+  return compare(a, b) < 0;
+}
+
+template <typename T, typename... S>
+bool operator>(const cbuffer<T, S...> &a, const cbuffer<T, S...> &b){
+  return compare(a, b) > 0;
+}
+
+template <typename T, typename... S>
+bool operator<=(const cbuffer<T, S...> &a, const cbuffer<T, S...> &b){
+  return compare(a, b) <= 0;
+}
+
+template <typename T, typename... S>
+bool operator>=(const cbuffer<T, S...> &a, const cbuffer<T, S...> &b){
+  return compare(a, b) >= 0;
 }
 #endif
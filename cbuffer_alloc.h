@@ -0,0 +1,304 @@
+#ifndef CBUFF_ALLOC_H
+#define CBUFF_ALLOC_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <sys/mman.h>    // mmap, madvise, munmap
+#include <sys/syscall.h> // SYS_mbind, SYS_getcpu
+#include <unistd.h>      // syscall
+/**
+@file cbuffer_alloc.h
+@brief Allocatori per heap_storage e pow2_storage (Linux): pool di blocchi
+della stessa dimensione e pagine grandi con posizionamento NUMA
+**/
+
+/**
+Pool di blocchi di dimensione fissa per creare e distruggere molti cbuffer
+della stessa capacità senza passare ogni volta dall'allocatore generale.
+I blocchi sono ritagliati da lastre allineate alla linea di cache (così due
+buffer non condividono mai una linea) e tornano in una lista libera quando
+il buffer viene distrutto; la memoria delle lastre si rilascia solo con la
+distruzione del pool. Le richieste più grandi di un blocco passano
+all'operator new. Thread-safe.
+Il pool deve sopravvivere a tutti i cbuffer che lo usano.
+**/
+class cbuffer_pool {
+public:
+  static const std::size_t alignment = 64;
+
+  /**
+  @brief Costruttore
+  @param block_bytes dimensione minima di un blocco in byte (arrotondata a 64)
+  @param blocks_per_slab numero di blocchi ritagliati da ogni lastra
+  **/
+  explicit cbuffer_pool(std::size_t block_bytes, std::size_t blocks_per_slab = 64)
+  : _block((block_bytes + alignment - 1) / alignment * alignment), _per_slab(blocks_per_slab),
+    _free(0), _in_use(0) {
+    if(_block == 0)
+      _block = alignment;
+    if(_per_slab == 0)
+      _per_slab = 1;
+  }
+
+  ~cbuffer_pool() {
+    for(std::size_t i = 0; i < _slabs.size(); ++i)
+      ::operator delete(_slabs[i], std::align_val_t(alignment));
+  }
+
+  cbuffer_pool(const cbuffer_pool &) = delete;
+  cbuffer_pool &operator=(const cbuffer_pool &) = delete;
+
+  std::size_t block_size() const {
+    return _block;
+  }
+
+  /**
+  @brief Numero di blocchi attualmente assegnati
+  **/
+  std::size_t blocks_in_use() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _in_use;
+  }
+
+  /**
+  @brief Numero di lastre allocate finora
+  **/
+  std::size_t slabs() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _slabs.size();
+  }
+
+  /**
+  @brief Blocco di almeno bytes byte, allineato a 64
+  @throw std::bad_alloc se la memoria è esaurita
+  **/
+  void *allocate(std::size_t bytes) {
+    if(bytes > _block)
+      return ::operator new(bytes, std::align_val_t(alignment));
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_free == 0)
+      refill();
+    node *n = _free;
+    _free = n->next;
+    ++_in_use;
+    return n;
+  }
+
+  /**
+  @brief Restituisce un blocco ottenuto con allocate(bytes)
+  **/
+  void deallocate(void *p, std::size_t bytes) {
+    if(bytes > _block) {
+      ::operator delete(p, std::align_val_t(alignment));
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    node *n = static_cast<node*>(p);
+    n->next = _free;
+    _free = n;
+    --_in_use;
+  }
+
+private:
+  struct node {
+    node *next;
+  };
+
+  // Nuova lastra: i suoi blocchi vanno tutti nella lista libera
+  void refill() {
+    _slabs.reserve(_slabs.size() + 1);
+    char *slab = static_cast<char*>(::operator new(_block * _per_slab, std::align_val_t(alignment)));
+    _slabs.push_back(slab);
+    for(std::size_t i = _per_slab; i-- > 0; ) {
+      node *n = reinterpret_cast<node*>(slab + i * _block);
+      n->next = _free;
+      _free = n;
+    }
+  }
+
+  std::size_t _block; ///< Dimensione di un blocco in byte
+  std::size_t _per_slab; ///< Blocchi per lastra
+  node *_free; ///< Lista dei blocchi liberi
+  std::size_t _in_use; ///< Blocchi assegnati
+  std::vector<void*> _slabs; ///< Lastre da rilasciare alla distruzione
+  mutable std::mutex _mutex; ///< Protegge lista libera e lastre
+};
+
+/**
+Allocatore standard che prende la memoria da un cbuffer_pool, ad esempio
+heap_storage<T, pool_allocator<T> >. Costruito senza pool si comporta come
+std::allocator (è il caso dei cbuffer vuoti creati dal move constructor).
+**/
+template <typename T>
+class pool_allocator {
+public:
+  typedef T value_type;
+
+  pool_allocator() noexcept : _pool(0) {
+  }
+
+  explicit pool_allocator(cbuffer_pool &pool) noexcept : _pool(&pool) {
+  }
+
+  template <typename U>
+  pool_allocator(const pool_allocator<U> &other) noexcept : _pool(other.pool()) {
+  }
+
+  T *allocate(std::size_t n) {
+    if(!use_pool())
+      return std::allocator<T>().allocate(n);
+    return static_cast<T*>(_pool->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    if(!use_pool())
+      std::allocator<T>().deallocate(p, n);
+    else
+      _pool->deallocate(p, n * sizeof(T));
+  }
+
+  cbuffer_pool *pool() const {
+    return _pool;
+  }
+
+private:
+  bool use_pool() const {
+    return _pool != 0 && alignof(T) <= cbuffer_pool::alignment;
+  }
+
+  cbuffer_pool *_pool; ///< Pool di provenienza (0: std::allocator)
+};
+
+template <typename T, typename U>
+bool operator==(const pool_allocator<T> &a, const pool_allocator<U> &b) {
+  return a.pool() == b.pool();
+}
+
+template <typename T, typename U>
+bool operator!=(const pool_allocator<T> &a, const pool_allocator<U> &b) {
+  return a.pool() != b.pool();
+}
+
+/**
+@brief Nodo NUMA della CPU su cui gira il thread chiamante (0 se non disponibile)
+**/
+inline int current_numa_node() {
+#ifdef SYS_getcpu
+  unsigned int cpu = 0, node = 0;
+  if(::syscall(SYS_getcpu, &cpu, &node, 0) == 0)
+    return static_cast<int>(node);
+#endif
+  return 0;
+}
+
+/**
+Allocatore standard per anelli grandi su pagine da 2 MB, che riducono i
+TLB miss nell'accesso casuale. Prova prima le pagine riservate (MAP_HUGETLB);
+se il sistema non ne ha, mappa memoria anonima allineata a 2 MB e chiede le
+transparent huge pages con madvise. Con un nodo NUMA (ad esempio
+current_numa_node() del thread consumatore) la memoria viene legata a quel
+nodo con mbind prima di essere toccata; strict sceglie MPOL_BIND invece di
+MPOL_PREFERRED. Se mbind non è disponibile la memoria segue la politica di
+default (first touch). Ogni allocazione è arrotondata a 2 MB, quindi è
+adatto solo a buffer grandi.
+**/
+template <typename T>
+class hugepage_allocator {
+public:
+  typedef T value_type;
+  static const std::size_t huge_page = std::size_t(2) << 20;
+
+  /**
+  @brief Costruttore
+  @param node nodo NUMA della memoria (-1: nessun vincolo)
+  @param strict true per MPOL_BIND (fallisce se il nodo è pieno), false per MPOL_PREFERRED
+  **/
+  explicit hugepage_allocator(int node = -1, bool strict = false) noexcept : _node(node), _strict(strict) {
+  }
+
+  template <typename U>
+  hugepage_allocator(const hugepage_allocator<U> &other) noexcept
+  : _node(other.numa_node()), _strict(other.strict()) {
+  }
+
+  /**
+  @throw std::bad_alloc se la mappatura fallisce
+  **/
+  T *allocate(std::size_t n) {
+    std::size_t bytes = round(n * sizeof(T));
+    void *p = ::mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(p == MAP_FAILED)
+      p = map_aligned(bytes);
+    if(p == 0)
+      throw std::bad_alloc();
+    bind(p, bytes);
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    ::munmap(p, round(n * sizeof(T)));
+  }
+
+  int numa_node() const {
+    return _node;
+  }
+
+  bool strict() const {
+    return _strict;
+  }
+
+private:
+  static std::size_t round(std::size_t bytes) {
+    return (bytes + huge_page - 1) / huge_page * huge_page;
+  }
+
+  // Memoria anonima allineata a 2 MB (si mappa di più e si tagliano i bordi),
+  // con la richiesta di transparent huge pages
+  static void *map_aligned(std::size_t bytes) {
+    void *raw = ::mmap(0, bytes + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED)
+      return 0;
+    char *base = static_cast<char*>(raw);
+    char *p = reinterpret_cast<char*>((reinterpret_cast<std::size_t>(base) + huge_page - 1) / huge_page * huge_page);
+    if(p != base)
+      ::munmap(base, p - base);
+    if(p + bytes != base + bytes + huge_page)
+      ::munmap(p + bytes, base + bytes + huge_page - (p + bytes));
+#ifdef MADV_HUGEPAGE
+    ::madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    return p;
+  }
+
+  void bind(void *p, std::size_t bytes) const {
+#ifdef SYS_mbind
+    if(_node < 0 || _node >= 64)
+      return;
+    const int mpol_preferred = 1, mpol_bind = 2;
+    unsigned long mask = 1ul << _node;
+    ::syscall(SYS_mbind, p, bytes, _strict ? mpol_bind : mpol_preferred, &mask, 64ul, 0u);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+  }
+
+  int _node; ///< Nodo NUMA (-1: nessun vincolo)
+  bool _strict; ///< MPOL_BIND invece di MPOL_PREFERRED
+};
+
+// Qualunque hugepage_allocator può rilasciare la memoria di un altro
+template <typename T, typename U>
+bool operator==(const hugepage_allocator<T> &, const hugepage_allocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const hugepage_allocator<T> &, const hugepage_allocator<U> &) {
+  return false;
+}
+
+#endif
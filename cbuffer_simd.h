@@ -0,0 +1,319 @@
+#ifndef CBUFF_SIMD_H
+#define CBUFF_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CBUFF_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+/**
+@file cbuffer_simd.h
+@brief Valutazione di predicati su tratti contigui, con kernel AVX2 per i
+confronti sui tipi aritmetici e ricaduta scalare
+**/
+
+/**
+Maschera di bit compatta: il bit i è il risultato del predicato sull'elemento
+di posizione logica i
+**/
+class cbuffer_bitmask {
+public:
+  typedef unsigned int size_type;
+
+  cbuffer_bitmask() : _size(0) {
+  }
+
+  explicit cbuffer_bitmask(size_type n) : _words((n + 63) / 64, 0), _size(n) {
+  }
+
+  size_type size() const {
+    return _size;
+  }
+
+  bool test(size_type i) const {
+    return (_words[i / 64] >> (i % 64)) & 1u;
+  }
+
+  /**
+  @brief Numero di bit a 1
+  **/
+  size_type count() const {
+    size_type n = 0;
+    for(std::size_t w = 0; w < _words.size(); ++w)
+      n += static_cast<size_type>(__builtin_popcountll(_words[w]));
+    return n;
+  }
+
+  /**
+  @brief Lista delle posizioni con il bit a 1, in ordine crescente
+  **/
+  std::vector<size_type> indices() const {
+    std::vector<size_type> out;
+    for(std::size_t w = 0; w < _words.size(); ++w)
+      for(std::uint64_t bits = _words[w]; bits != 0; bits &= bits - 1)
+        out.push_back(static_cast<size_type>(w * 64 + __builtin_ctzll(bits)));
+    return out;
+  }
+
+  const std::uint64_t *words() const {
+    return _words.empty() ? 0 : &_words[0];
+  }
+
+  /**
+  @brief Scrive count bit (al più 32) a partire dalla posizione pos
+  **/
+  void set_bits(size_type pos, std::uint32_t bits, unsigned int count) {
+    if(count == 0)
+      return;
+    std::uint64_t b = bits & (count == 32 ? 0xffffffffull : ((1ull << count) - 1));
+    size_type w = pos / 64, off = pos % 64;
+    _words[w] |= b << off;
+    if(off + count > 64)
+      _words[w + 1] |= b >> (64 - off);
+  }
+
+private:
+  std::vector<std::uint64_t> _words; ///< Bit raggruppati a 64 per parola
+  size_type _size; ///< Numero di bit significativi
+};
+
+/**
+Operatori di confronto riconosciuti dai kernel vettoriali
+**/
+enum cbuffer_cmp { cmp_less, cmp_less_equal, cmp_greater, cmp_greater_equal, cmp_equal, cmp_not_equal };
+
+/**
+Predicato "elemento <op> valore". Si usa come un normale funtore; per int,
+float e double i kernel AVX2 lo riconoscono e confrontano 8 (o 4) elementi
+per volta.
+**/
+template <typename T, cbuffer_cmp Op>
+struct cbuffer_compare {
+  T value;
+
+  explicit cbuffer_compare(const T &v) : value(v) {
+  }
+
+  bool operator()(const T &x) const {
+    switch(Op) {
+      case cmp_less:          return x < value;
+      case cmp_less_equal:    return x <= value;
+      case cmp_greater:       return x > value;
+      case cmp_greater_equal: return x >= value;
+      case cmp_equal:         return x == value;
+      default:                return x != value;
+    }
+  }
+};
+
+// Funzioni di comodo per costruire i predicati
+template <typename T> cbuffer_compare<T, cmp_less> less_than(const T &v) { return cbuffer_compare<T, cmp_less>(v); }
+template <typename T> cbuffer_compare<T, cmp_less_equal> less_equal(const T &v) { return cbuffer_compare<T, cmp_less_equal>(v); }
+template <typename T> cbuffer_compare<T, cmp_greater> greater_than(const T &v) { return cbuffer_compare<T, cmp_greater>(v); }
+template <typename T> cbuffer_compare<T, cmp_greater_equal> greater_equal(const T &v) { return cbuffer_compare<T, cmp_greater_equal>(v); }
+template <typename T> cbuffer_compare<T, cmp_equal> equal_to(const T &v) { return cbuffer_compare<T, cmp_equal>(v); }
+template <typename T> cbuffer_compare<T, cmp_not_equal> not_equal_to(const T &v) { return cbuffer_compare<T, cmp_not_equal>(v); }
+
+namespace cbuffer_detail {
+
+/**
+Scansione di un tratto contiguo: per ogni blocco di al più 32 elementi
+chiama sink(bits, len, pos), dove pos è la posizione logica del primo
+elemento del blocco. Se sink ritorna false la scansione si ferma e la
+funzione ritorna false.
+**/
+template <typename T, typename P, typename Sink>
+bool scan_scalar(const T *p, std::size_t n, const P &pred, Sink &sink, std::size_t pos) {
+  for(std::size_t i = 0; i < n; i += 32) {
+    unsigned int len = static_cast<unsigned int>(n - i < 32 ? n - i : 32);
+    std::uint32_t bits = 0;
+    for(unsigned int j = 0; j < len; ++j)
+      bits |= static_cast<std::uint32_t>(pred(p[i + j]) ? 1u : 0u) << j;
+    if(!sink(bits, len, pos + i))
+      return false;
+  }
+  return true;
+}
+
+#ifdef CBUFF_SIMD_AVX2
+
+inline bool has_avx2() {
+  static const bool ok = __builtin_cpu_supports("avx2");
+  return ok;
+}
+
+// Confronto di 8 int: i predicati <=, >= e != sono la negazione di >, < e ==
+template <cbuffer_cmp Op>
+__attribute__((target("avx2"))) inline std::uint32_t cmp8(__m256i x, __m256i v) {
+  __m256i r;
+  if(Op == cmp_less || Op == cmp_greater_equal)
+    r = _mm256_cmpgt_epi32(v, x);
+  else if(Op == cmp_greater || Op == cmp_less_equal)
+    r = _mm256_cmpgt_epi32(x, v);
+  else
+    r = _mm256_cmpeq_epi32(x, v);
+  std::uint32_t bits = static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(r)));
+  if(Op == cmp_less_equal || Op == cmp_greater_equal || Op == cmp_not_equal)
+    bits = ~bits & 0xffu;
+  return bits;
+}
+
+template <cbuffer_cmp Op>
+struct avx_pred {
+  static const int value = Op == cmp_less ? _CMP_LT_OQ : Op == cmp_less_equal ? _CMP_LE_OQ :
+                           Op == cmp_greater ? _CMP_GT_OQ : Op == cmp_greater_equal ? _CMP_GE_OQ :
+                           Op == cmp_equal ? _CMP_EQ_OQ : _CMP_NEQ_UQ;
+};
+
+template <cbuffer_cmp Op, typename Sink>
+__attribute__((target("avx2"))) bool scan_avx2(const int *p, std::size_t n, int value, Sink &sink, std::size_t pos) {
+  __m256i v = _mm256_set1_epi32(value);
+  std::size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    std::uint32_t bits = 0;
+    for(unsigned int k = 0; k < 4; ++k)
+      bits |= cmp8<Op>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 8 * k)), v) << (8 * k);
+    if(!sink(bits, 32u, pos + i))
+      return false;
+  }
+  return scan_scalar(p + i, n - i, cbuffer_compare<int, Op>(value), sink, pos + i);
+}
+
+template <cbuffer_cmp Op, typename Sink>
+__attribute__((target("avx2"))) bool scan_avx2(const float *p, std::size_t n, float value, Sink &sink, std::size_t pos) {
+  __m256 v = _mm256_set1_ps(value);
+  std::size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    std::uint32_t bits = 0;
+    for(unsigned int k = 0; k < 4; ++k) {
+      __m256 r = _mm256_cmp_ps(_mm256_loadu_ps(p + i + 8 * k), v, avx_pred<Op>::value);
+      bits |= static_cast<std::uint32_t>(_mm256_movemask_ps(r)) << (8 * k);
+    }
+    if(!sink(bits, 32u, pos + i))
+      return false;
+  }
+  return scan_scalar(p + i, n - i, cbuffer_compare<float, Op>(value), sink, pos + i);
+}
+
+template <cbuffer_cmp Op, typename Sink>
+__attribute__((target("avx2"))) bool scan_avx2(const double *p, std::size_t n, double value, Sink &sink, std::size_t pos) {
+  __m256d v = _mm256_set1_pd(value);
+  std::size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    std::uint32_t bits = 0;
+    for(unsigned int k = 0; k < 8; ++k) {
+      __m256d r = _mm256_cmp_pd(_mm256_loadu_pd(p + i + 4 * k), v, avx_pred<Op>::value);
+      bits |= static_cast<std::uint32_t>(_mm256_movemask_pd(r)) << (4 * k);
+    }
+    if(!sink(bits, 32u, pos + i))
+      return false;
+  }
+  return scan_scalar(p + i, n - i, cbuffer_compare<double, Op>(value), sink, pos + i);
+}
+
+#endif
+
+template <typename T>
+struct has_simd_kernel {
+  static const bool value = std::is_same<T, int>::value || std::is_same<T, float>::value ||
+                            std::is_same<T, double>::value;
+};
+
+/**
+Scansione di un tratto contiguo con il kernel migliore disponibile
+**/
+template <typename T, typename P, typename Sink>
+bool scan(const T *p, std::size_t n, const P &pred, Sink &sink, std::size_t pos) {
+  return scan_scalar(p, n, pred, sink, pos);
+}
+
+template <typename T, cbuffer_cmp Op, typename Sink>
+bool scan(const T *p, std::size_t n, const cbuffer_compare<T, Op> &pred, Sink &sink, std::size_t pos) {
+#ifdef CBUFF_SIMD_AVX2
+  if constexpr (has_simd_kernel<T>::value) {
+    if(has_avx2())
+      return scan_avx2<Op>(p, n, pred.value, sink, pos);
+  }
+#endif
+  return scan_scalar(p, n, pred, sink, pos);
+}
+
+/**
+Scansione di una sequenza fatta di tratti contigui (C fornisce for_each_segment)
+**/
+template <typename C, typename P, typename Sink>
+void scan_segments(const C &c, const P &pred, Sink &sink) {
+  std::size_t pos = 0;
+  bool go = true;
+  c.for_each_segment([&](const typename C::value_type *p, typename C::size_type n) {
+    if(go)
+      go = scan(p, n, pred, sink, pos);
+    pos += n;
+  });
+}
+
+/**
+Maschera del predicato su una sequenza a tratti (C fornisce anche countelem)
+**/
+template <typename C, typename P>
+cbuffer_bitmask mask_segments(const C &c, const P &pred) {
+  cbuffer_bitmask mask(c.countelem());
+  auto sink = [&mask](std::uint32_t bits, unsigned int len, std::size_t pos) {
+    mask.set_bits(static_cast<cbuffer_bitmask::size_type>(pos), bits, len);
+    return true;
+  };
+  scan_segments(c, pred, sink);
+  return mask;
+}
+
+/**
+Numero di elementi di una sequenza a tratti che soddisfano il predicato
+**/
+template <typename C, typename P>
+typename C::size_type count_segments(const C &c, const P &pred) {
+  typename C::size_type n = 0;
+  auto sink = [&n](std::uint32_t bits, unsigned int, std::size_t) {
+    n += static_cast<unsigned int>(__builtin_popcount(bits));
+    return true;
+  };
+  scan_segments(c, pred, sink);
+  return n;
+}
+
+/**
+Posizione del primo elemento che soddisfa il predicato (countelem() se non
+c'è); la scansione si ferma al primo blocco che lo contiene
+**/
+template <typename C, typename P>
+typename C::size_type find_segments(const C &c, const P &pred) {
+  typename C::size_type found = c.countelem();
+  auto sink = [&found](std::uint32_t bits, unsigned int, std::size_t pos) {
+    if(bits == 0)
+      return true;
+    found = static_cast<unsigned int>(pos + __builtin_ctz(bits));
+    return false;
+  };
+  scan_segments(c, pred, sink);
+  return found;
+}
+
+/**
+Stampa su std::cout il predicato su ogni elemento di una sequenza a tratti
+(una riga "[i] : true/false" per elemento, un solo flush alla fine)
+**/
+template <typename C, typename P>
+void print_segments(const C &c, const P &pred) {
+  cbuffer_bitmask mask = mask_segments(c, pred);
+  for(cbuffer_bitmask::size_type i = 0; i < mask.size(); ++i)
+    std::cout<<"["<<i<<"] : "<<(mask.test(i) ? "true" : "false")<<'\n';
+  std::cout.flush();
+}
+
+} // namespace cbuffer_detail
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef CBUFF_SOA_H
+#define CBUFF_SOA_H
+
+#include "cbuffer.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+/**
+@file cbuffer_soa.h
+@brief Dichiarazione delle classi cbuffer_soa e cbuffer_column
+**/
+
+/**
+Vista in sola lettura su una colonna di cbuffer_soa: gli elementi di un
+campo in ordine logico, al più in due tratti contigui come in cbuffer.
+Offre for_each_segment, quindi evaluate_mask, count_if, find_if, any_of
+ed evaluate_if usano gli stessi kernel (AVX2 per int, float e double)
+dei cbuffer. Resta valida finché il cbuffer_soa non viene modificato.
+**/
+template <typename T>
+class cbuffer_column {
+public:
+  typedef unsigned int size_type;
+  typedef T value_type;
+  typedef std::pair<const T*, size_type> const_array_range; ///< Tratto contiguo (puntatore, lunghezza)
+
+  cbuffer_column(const T *data, size_type capacity, size_type first, size_type count)
+  : _data(data), _capacity(capacity), _first(first), _count(count) {
+  }
+
+  size_type countelem() const {
+    return _count;
+  }
+
+  bool isEmpty() const {
+    return _count == 0;
+  }
+
+  /**
+  @brief Elemento di posizione logica index
+  @pre index < countelem()
+  **/
+  const T &operator[](size_type index) const {
+    assert(index < _count);
+    size_type i = _first + index;
+    return _data[i >= _capacity ? i - _capacity : i];
+  }
+
+  /**
+  @brief Primo tratto contiguo (da first alla fine dell'array)
+  **/
+  const_array_range array_one() const {
+    return const_array_range(_data + _first, first_segment());
+  }
+
+  /**
+  @brief Secondo tratto contiguo (dall'inizio dell'array), lunghezza 0 se non c'è
+  **/
+  const_array_range array_two() const {
+    return const_array_range(_data, _count - first_segment());
+  }
+
+  template <typename F>
+  void for_each_segment(F f) const {
+    size_type n1 = first_segment();
+    if(n1 != 0)
+      f(_data + _first, n1);
+    if(_count != n1)
+      f(_data, _count - n1);
+  }
+
+private:
+  size_type first_segment() const {
+    return _count < _capacity - _first ? _count : _capacity - _first;
+  }
+
+  const T *_data; ///< Array della colonna
+  size_type _capacity; ///< Celle dell'array
+  size_type _first; ///< Cella dell'elemento più vecchio
+  size_type _count; ///< Numero di elementi
+};
+
+/**
+Buffer circolare a colonne (struct of arrays) per record di più campi:
+un array per campo, tutti con la stessa testa e lo stesso numero di
+elementi. Una scansione su un campo legge solo la sua colonna, densa e
+contigua, invece di trascinare in cache i record interi.
+Come cbuffer, a buffer pieno il record più vecchio viene sovrascritto.
+I campi devono essere banalmente copiabili e distruttibili (numeri,
+array di caratteri...): così ogni colonna si copia con memcpy e non ci
+sono costruzioni parziali di un record da annullare.
+@tparam Fields tipi dei campi, nell'ordine delle colonne
+**/
+template <typename... Fields>
+class cbuffer_soa {
+  static_assert(sizeof...(Fields) > 0, "cbuffer_soa richiede almeno un campo");
+  static_assert((std::is_trivially_copyable<Fields>::value && ...),
+                "cbuffer_soa richiede campi banalmente copiabili");
+
+public:
+  typedef unsigned int size_type;
+  typedef std::tuple<Fields...> value_type; ///< Record completo
+
+  /**
+  @brief Tipo del campo I
+  **/
+  template <std::size_t I>
+  using field_type = typename std::tuple_element<I, value_type>::type;
+
+  static const std::size_t columns = sizeof...(Fields);
+
+  cbuffer_soa() : first(0), nelem(0) {
+  }
+
+  /**
+  @brief Costruttore
+  @param size numero di record
+  **/
+  explicit cbuffer_soa(size_type size) : _columns(column_size<Fields>(size)...), first(0), nelem(0) {
+  }
+
+  /**
+  @brief Copy constructor: copia le celle occupate di ogni colonna (al più due memcpy per colonna)
+  **/
+  cbuffer_soa(const cbuffer_soa &other)
+  : _columns(column_size<Fields>(other.capacity())...), first(other.first), nelem(other.nelem) {
+    copy_columns(other, std::index_sequence_for<Fields...>());
+  }
+
+  cbuffer_soa(cbuffer_soa &&other) noexcept : first(0), nelem(0) {
+    swap(other);
+  }
+
+  cbuffer_soa &operator=(const cbuffer_soa &other) {
+    if(this != &other) {
+      cbuffer_soa tmp(other);
+      swap(tmp);
+    }
+    return *this;
+  }
+
+  cbuffer_soa &operator=(cbuffer_soa &&other) noexcept {
+    if(this != &other) {
+      clear();
+      swap(other);
+    }
+    return *this;
+  }
+
+  void swap(cbuffer_soa &other) {
+    swap_columns(other, std::index_sequence_for<Fields...>());
+    std::swap(first, other.first);
+    std::swap(nelem, other.nelem);
+  }
+
+  size_type capacity() const {
+    return std::get<0>(_columns).capacity();
+  }
+
+  size_type countelem() const {
+    return nelem;
+  }
+
+  bool isEmpty() const {
+    return nelem == 0;
+  }
+
+  bool isFull() const {
+    return nelem == capacity();
+  }
+
+  /**
+  @brief Accoda un record; se il buffer è pieno il più vecchio viene sovrascritto
+  @param row record (una tupla con un valore per campo)
+  @return true
+  **/
+  bool enqueue(const value_type &row) {
+    return std::apply([this](const Fields&... fields) { return emplace(fields...); }, row);
+  }
+
+  /**
+  @brief Accoda un record passando i campi separatamente
+  @param fields un valore per campo
+  @return true
+  **/
+  bool emplace(const Fields&... fields) {
+    assert(capacity() != 0);
+    size_type pos = wrap(first + nelem);   // a buffer pieno è la cella del più vecchio
+    store(pos, std::index_sequence_for<Fields...>(), fields...);
+    size_type full = (nelem == capacity());
+    first = wrap(first + full);
+    nelem += 1 - full;
+    return true;
+  }
+
+  /**
+  @brief Toglie il record più vecchio (come cbuffer::pop)
+  @pre il buffer non è vuoto
+  @return true
+  **/
+  bool pop() {
+    assert(!isEmpty());
+    first = wrap(first + 1);
+    --nelem;
+    return true;
+  }
+
+  void clear() {
+    first = 0;
+    nelem = 0;
+  }
+
+  /**
+  @brief Record di posizione logica index ricomposto in una tupla
+  @pre index < countelem()
+  **/
+  value_type operator[](size_type index) const {
+    assert(index < nelem);
+    return row(wrap(first + index), std::index_sequence_for<Fields...>());
+  }
+
+  /**
+  @brief Campo I del record di posizione logica index
+  @pre index < countelem()
+  **/
+  template <std::size_t I>
+  field_type<I> &get(size_type index) {
+    assert(index < nelem);
+    return std::get<I>(_columns).data()[wrap(first + index)];
+  }
+
+  template <std::size_t I>
+  const field_type<I> &get(size_type index) const {
+    assert(index < nelem);
+    return std::get<I>(_columns).data()[wrap(first + index)];
+  }
+
+  /**
+  @brief Vista sulla colonna del campo I
+  **/
+  template <std::size_t I>
+  cbuffer_column<field_type<I> > column() const {
+    return cbuffer_column<field_type<I> >(std::get<I>(_columns).data(), capacity(), first, nelem);
+  }
+
+private:
+  // Un argomento size per ogni campo, per costruire la tupla di colonne
+  template <typename F>
+  static size_type column_size(size_type size) {
+    return size;
+  }
+
+  size_type wrap(size_type i) const {
+    return std::get<0>(_columns).wrap(i);
+  }
+
+  template <std::size_t... I>
+  void store(size_type pos, std::index_sequence<I...>, const Fields&... fields) {
+    (::new (static_cast<void*>(std::get<I>(_columns).data() + pos)) Fields(fields), ...);
+  }
+
+  template <std::size_t... I>
+  value_type row(size_type pos, std::index_sequence<I...>) const {
+    return value_type(std::get<I>(_columns).data()[pos]...);
+  }
+
+  template <std::size_t... I>
+  void copy_columns(const cbuffer_soa &other, std::index_sequence<I...>) {
+    (copy_column(std::get<I>(_columns).data(), std::get<I>(other._columns).data()), ...);
+  }
+
+  // Copia le celle occupate mantenendo le posizioni (stessa testa di other)
+  template <typename T>
+  void copy_column(T *dst, const T *src) {
+    size_type n1 = nelem < capacity() - first ? nelem : capacity() - first;
+    if(n1 != 0)
+      std::memcpy(dst + first, src + first, n1 * sizeof(T));
+    if(nelem != n1)
+      std::memcpy(dst, src, (nelem - n1) * sizeof(T));
+  }
+
+  template <std::size_t... I>
+  void swap_columns(cbuffer_soa &other, std::index_sequence<I...>) {
+    (std::get<I>(_columns).swap(std::get<I>(other._columns)), ...);
+  }
+
+  std::tuple<heap_storage<Fields>...> _columns; ///< Un array per campo, tutti della stessa capacità
+  size_type first; ///< Cella del record più vecchio
+  size_type nelem; ///< Numero di record presenti
+};
+
+/**
+  Valuta un predicato unario su ogni elemento della colonna (vedi evaluate_mask per cbuffer)
+*/
+
+template <typename T, typename P>
+cbuffer_bitmask evaluate_mask(const cbuffer_column<T> &C, P pred){
+  return cbuffer_detail::mask_segments(C, pred);
+}
+
+template <typename T, typename P>
+typename cbuffer_column<T>::size_type count_if(const cbuffer_column<T> &C, P pred){
+  return cbuffer_detail::count_segments(C, pred);
+}
+
+template <typename T, typename P>
+typename cbuffer_column<T>::size_type find_if(const cbuffer_column<T> &C, P pred){
+  return cbuffer_detail::find_segments(C, pred);
+}
+
+template <typename T, typename P>
+bool any_of(const cbuffer_column<T> &C, P pred){
+  return find_if(C, pred) != C.countelem();
+}
+
+/**
+  Stampa il risultato del predicato su ogni elemento della colonna
+  (una riga per elemento, come evaluate_if per cbuffer)
+*/
+
+template <typename T, typename fctr>
+void evaluate_if(const cbuffer_column<T> &C, fctr functor){
+  cbuffer_detail::print_segments(C, functor);
+}
+
+#endif
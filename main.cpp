@@ -1,9 +1,27 @@
 #include "cbuffer.h"
+#include "spsc_cbuffer.h"
+#include "mpmc_cbuffer.h"
+#include "blocking_cbuffer.h"
+#include "vmring_storage.h"
+#include "mmap_storage.h"
+#include "aggregating_cbuffer.h"
+#include "quantile_cbuffer.h"
+#include "cbuffer_alloc.h"
+#include "sharded_cbuffer.h"
+#include "cbuffer_soa.h"
 #include <iostream> // std::cout
 #include <stdexcept> // std::out_of_range
 #include <cassert> // assert
 
 #include <vector>
+#include <cstring> // std::memcpy
+#include <algorithm> // std::sort, std::lower_bound
+#include <thread>
+#include <cstdio> // std::remove
+#include <cmath> // std::fabs
+#include <sstream> // std::ostringstream, std::stringstream
+#include <functional> // std::function
+#include <string>
 
 //tipo custom per test
 struct course {
@@ -14,12 +32,55 @@ struct course {
     bool operator!=(const course c) const{
       return ( credits != c.credits || name != c.name );
     }
+    bool operator==(const course &c) const{
+      return !(*this != c);
+    }
     unsigned int getCredits() const{
       return credits;
     }
 };
 
 
+//tipo senza costruttore di default che conta le istanze vive
+struct contato {
+    static int vivi;
+    static int copie;
+    int valore;
+    explicit contato(int v) : valore(v) { ++vivi; }
+    contato(const contato &c) : valore(c.valore) { ++vivi; ++copie; }
+    contato(contato &&c) noexcept : valore(c.valore) { ++vivi; }
+    ~contato() { --vivi; }
+};
+
+int contato::vivi = 0;
+int contato::copie = 0;
+
+//distruttore banale ma costruttori che leggono la sorgente campo per campo
+//dopo aver scritto la destinazione
+struct coppia {
+    int a, b;
+    coppia(const int &x, const int &y) : a(x), b(y) {}
+    coppia(const coppia &c) : a(0), b(0) { a = c.a; b = c.b; }
+};
+
+//tipo che conta le istanze vive e la cui copia lancia esaurite le copie permesse
+struct fragile {
+    static int vivi;
+    static int permesse;
+    fragile() { ++vivi; }
+    fragile(const fragile &) {
+      if(permesse == 0)
+        throw std::runtime_error("copia non permessa");
+      --permesse;
+      ++vivi;
+    }
+    fragile &operator=(const fragile &) = default;
+    ~fragile() { --vivi; }
+};
+
+int fragile::vivi = 0;
+int fragile::permesse = 0;
+
 //funzioni e costrutti usati nel test di evaluate_if
 bool even(int i){
     if ((i % 2) == 0)
@@ -148,6 +209,1047 @@ void provaevaluateif(){
   evaluate_if(CBprov2,even);
 }
 
+//test indici testa+conteggio e modalità potenza di due
+
+void provaindicipow2(){
+  cbuffer<int> CB(5);
+  cbuffer<int, pow2_storage<int> > CBp(5);
+  for(int i = 0; i < 13; ++i){
+    CB.enqueue(i);
+    CBp.enqueue(i);
+  }
+  CB.pop();
+  CBp.pop();
+  // CB contiene 9..12, CBp (capacità 8) contiene 6..12
+  if(CBp.capacity() != 8 || CB.countelem() != 4 || CBp.countelem() != 7)
+    std::cout<<"capacita'/conteggio errati"<<std::endl;
+  else if(CB[0] != 9 || CB[3] != 12 || CBp[0] != 6 || CBp[6] != 12)
+    std::cout<<"indici circolari errati"<<std::endl;
+  else{
+    int atteso = 6, letti = 0;
+    cbuffer<int, pow2_storage<int> >::const_iterator i, ie;
+    for(i = CBp.begin(), ie = CBp.end(); i != ie; ++i, ++atteso, ++letti)
+      if(*i != atteso)
+        break;
+    if(letti == 7)
+      std::cout<<"test indici testa/conteggio e pow2 PASSATO"<<std::endl;
+    else
+      std::cout<<"iteratori su buffer circolare errati"<<std::endl;
+  }
+}
+
+//test cbuffer a capacità fissa (stesso comportamento della versione dinamica)
+
+void provafixedcbuffer(){
+  typedef fixed_cbuffer<int, 3> fixed3;
+  cbuffer<int> CBd(3);
+  fixed3 CBf;
+  for(int i = 0; i < 5; ++i){
+    CBd.enqueue(i);
+    CBf.enqueue(i);
+  }
+  fixed3 CBcopia(CBf);
+  bool uguali = CBf.countelem() == CBd.countelem() && CBcopia.equals(CBf);
+  for(unsigned int i = 0; uguali && i < CBd.countelem(); ++i)
+    uguali = CBf[i] == CBd[i];
+  if(sizeof(fixed3) < 3 * sizeof(int) || fixed3::storage_type::static_capacity != 3)
+    std::cout<<"fixed_cbuffer non contiene gli elementi"<<std::endl;
+  else if(!uguali)
+    std::cout<<"fixed_cbuffer diverso da cbuffer dinamico"<<std::endl;
+  else
+    std::cout<<"test fixed_cbuffer PASSATO"<<std::endl;
+}
+
+//test memoria non inizializzata: emplace, enqueue con move e distruzioni
+
+void provaemplaceedistruzioni(){
+  bool ok = true;
+  {
+    cbuffer<contato> CB(3);
+    ok = ok && contato::vivi == 0;     //nessuna costruzione anticipata
+    CB.emplace(1);
+    CB.emplace(2);
+    CB.enqueue(contato(3));
+    CB.emplace(4);                     //sovrascrive (e distrugge) il più vecchio
+    ok = ok && contato::vivi == 3 && CB[0].valore == 2;
+    CB.pop();
+    ok = ok && contato::vivi == 2 && CB[0].valore == 3;
+    fixed_cbuffer<contato, 2> CBf;
+    CBf.emplace(7);
+    ok = ok && contato::vivi == 3;
+  }
+  ok = ok && contato::vivi == 0;       //il distruttore distrugge solo i vivi
+
+  cbuffer<std::string> CBs(2);
+  std::string lungo(100, 'x');
+  CBs.enqueue(std::move(lungo));
+  CBs.emplace(3, 'y');
+  ok = ok && CBs[0].size() == 100 && CBs[1] == "yyy";
+  if(ok)
+    std::cout<<"test emplace, move e distruzione elementi PASSATO"<<std::endl;
+  else
+    std::cout<<"costruzione/distruzione elementi errata"<<std::endl;
+}
+
+//test enqueue a buffer pieno di un elemento del buffer stesso (anche il più vecchio)
+
+void provaaccodaelemento(){
+  cbuffer<std::string> CB(3);
+  CB.enqueue(std::string(40, 'a'));
+  CB.enqueue(std::string(40, 'b'));
+  CB.enqueue(std::string(40, 'c'));
+  CB.enqueue(CB[0]);                    //il più vecchio viene sovrascritto dopo la copia
+  bool ok = CB.countelem() == 3 && CB[0] == std::string(40, 'b') && CB[2] == std::string(40, 'a');
+  CB.emplace(CB[0]);
+  ok = ok && CB[0] == std::string(40, 'c') && CB[2] == std::string(40, 'b');
+  std::vector<std::string> archivio;
+  cbuffer<std::string, heap_storage<std::string>, no_stats,
+          spill_oldest<std::function<void(std::string&&)> > > S(2);
+  S.overflow().spill = [&archivio](std::string &&s) { archivio.push_back(std::move(s)); };
+  S.enqueue(std::string(40, 'x'));
+  S.enqueue(std::string(40, 'y'));
+  S.enqueue(S[0]);
+  ok = ok && archivio.size() == 1 && archivio[0] == std::string(40, 'x') && S[1] == std::string(40, 'x');
+  {
+    cbuffer<contato> C(2);
+    C.emplace(1);
+    C.emplace(2);
+    C.enqueue(C[0]);
+    ok = ok && C[1].valore == 1 && contato::vivi == 2;
+  }
+  ok = ok && contato::vivi == 0;
+  cbuffer<coppia> P(2);
+  P.emplace(1, 2);
+  P.emplace(3, 4);
+  P.enqueue(P[0]);                      //costruita sopra la propria sorgente senza appoggio
+  ok = ok && P[0].a == 3 && P[1].a == 1 && P[1].b == 2;
+  P.emplace(P[0].b, P[0].a);            //argomenti che puntano nella cella sovrascritta
+  ok = ok && P[1].a == 4 && P[1].b == 3;
+  if(ok)
+    std::cout<<"test enqueue di un elemento del buffer pieno PASSATO"<<std::endl;
+  else
+    std::cout<<"enqueue da un elemento del buffer errato"<<std::endl;
+}
+
+//test move constructor/assegnamento e copia dei soli elementi presenti
+
+void provamoveecopia(){
+  bool ok = std::is_nothrow_move_constructible<cbuffer<std::string> >::value;
+  cbuffer<contato> CB(100);
+  CB.emplace(1);
+  CB.emplace(2);
+  contato::copie = 0;
+  cbuffer<contato> CBc(CB);              //copia solo i 2 elementi presenti
+  ok = ok && contato::copie == 2 && CBc.capacity() == 100;
+  std::vector<cbuffer<contato> > vec;
+  for(int i = 0; i < 8; ++i)
+    vec.push_back(cbuffer<contato>(100)); //riallocazioni con move
+  vec.push_back(std::move(CBc));
+  ok = ok && contato::copie == 2 && CBc.countelem() == 0 && vec.back()[1].valore == 2;
+
+  int arr[4] = {1, 2, 3, 4};
+  cbuffer<int> CBi(4, arr), CBi2(4);
+  CBi.enqueue(5);                        //elementi a cavallo della fine dell'array
+  CBi2 = CBi;
+  fixed_cbuffer<int, 4> CBf, CBf2;
+  CBf.enqueue(9);
+  CBf2 = std::move(CBf);
+  ok = ok && CBi2.equals(CBi) && CBi2[0] == 2 && CBi2[3] == 5 && CBf2[0] == 9 && CBf.isEmpty();
+  if(ok)
+    std::cout<<"test move e copia elementi presenti PASSATO"<<std::endl;
+  else
+    std::cout<<"move/copia errati"<<std::endl;
+}
+
+//test inserimento/estrazione a blocchi
+
+void provaenqueuendequeuen(){
+  int dati[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  int fuori[10] = {0};
+  cbuffer<int> CB(6);
+  CB.enqueue_n(dati, 4);                 //0..3
+  bool ok = CB.dequeue_n(fuori, 3) == 3 && fuori[2] == 2;
+  CB.enqueue_n(dati + 4, 5);             //3..8, scrittura a cavallo della fine
+  ok = ok && CB.countelem() == 6 && CB[0] == 3 && CB[5] == 8;
+  CB.enqueue_n(dati + 2, 2);             //sovrascrive 3 e 4
+  ok = ok && CB[0] == 5 && CB[5] == 3;
+  CB.enqueue_n(dati, 10);                //restano gli ultimi 6
+  ok = ok && CB.dequeue_n(fuori, 10) == 6 && fuori[0] == 4 && fuori[5] == 9 && CB.isEmpty();
+
+  std::vector<std::string> parole;
+  parole.push_back("a");
+  parole.push_back("b");
+  parole.push_back("c");
+  cbuffer<std::string> CBs(2);
+  CBs.enqueue_n(parole.begin(), parole.end());
+  std::string out[2];
+  ok = ok && CBs.dequeue_n(out, 2) == 2 && out[0] == "b" && out[1] == "c";
+  if(ok)
+    std::cout<<"test enqueue_n/dequeue_n PASSATO"<<std::endl;
+  else
+    std::cout<<"enqueue_n/dequeue_n errati"<<std::endl;
+}
+
+//test enqueue_n con una sequenza presa dal cbuffer stesso
+
+void provaenqueuenstesso(){
+  cbuffer<int> C(4);
+  for(int i = 1; i <= 6; ++i)           //3 4 5 6, su due tratti
+    C.enqueue(i);
+  C.enqueue_n(C.begin(), C.end());
+  bool ok = C.countelem() == 4 && C[0] == 3 && C[1] == 4 && C[2] == 5 && C[3] == 6;
+  C.enqueue_n(C.array_one().first, 2);  //puntatori nell'array: 3 e 4
+  ok = ok && C[0] == 5 && C[1] == 6 && C[2] == 3 && C[3] == 4;
+  C.enqueue_n(C.rbegin(), C.rend());    //a ritroso: 4 3 6 5
+  ok = ok && C[0] == 4 && C[1] == 3 && C[2] == 6 && C[3] == 5;
+  const cbuffer<int> &CC = C;
+  C.enqueue_n(CC.rbegin(), CC.rend());
+  ok = ok && C[0] == 5 && C[1] == 6 && C[2] == 3 && C[3] == 4;
+  const int *p1 = CC.array_one().first;
+  C.enqueue_n(std::reverse_iterator<const int*>(p1 + 2), std::reverse_iterator<const int*>(p1));
+  ok = ok && C[0] == 3 && C[1] == 4 && C[2] == 6 && C[3] == 5;
+  cbuffer<std::string> S(3);
+  S.enqueue(std::string(30, 'a'));
+  S.enqueue(std::string(30, 'b'));
+  S.enqueue(std::string(30, 'c'));
+  const cbuffer<std::string> &CS = S;
+  S.enqueue_n(CS.begin() + 1, CS.end());
+  ok = ok && S[0] == std::string(30, 'c') && S[1] == std::string(30, 'b') && S[2] == std::string(30, 'c');
+  if(ok)
+    std::cout<<"test enqueue_n dal cbuffer stesso PASSATO"<<std::endl;
+  else
+    std::cout<<"enqueue_n dal cbuffer stesso errato"<<std::endl;
+}
+
+//test tratti contigui per I/O scatter-gather (simulato con memcpy)
+
+void provaarrayoneetwo(){
+  char sorgente[] = "abcdefgh";
+  char letto[9] = {0};
+  cbuffer<char> CB(6);
+  CB.enqueue_n(sorgente, 4);
+  CB.consume(3);                         //resta "d", first = 3
+  cbuffer<char>::array_range w1 = CB.write_array_one(), w2 = CB.write_array_two();
+  bool ok = w1.second == 2 && w2.second == 3;
+  std::memcpy(w1.first, sorgente + 4, w1.second);  //"recv" nelle celle libere
+  std::memcpy(w2.first, sorgente + 6, 2);
+  CB.commit_write(4);                    //"defgh"
+  cbuffer<char>::const_array_range r1 = CB.array_one(), r2 = CB.array_two();
+  std::memcpy(letto, r1.first, r1.second);         //"writev" dei due tratti
+  std::memcpy(letto + r1.second, r2.first, r2.second);
+  ok = ok && r1.second + r2.second == 5 && std::string(letto) == "defgh";
+  CB.consume(5);
+  ok = ok && CB.isEmpty() && CB.array_one().second == 0 && CB.array_two().second == 0;
+  if(ok)
+    std::cout<<"test array_one/array_two e commit_write/consume PASSATO"<<std::endl;
+  else
+    std::cout<<"tratti contigui errati"<<std::endl;
+}
+
+//test iteratori ad accesso casuale, inversi e algoritmi segmentati
+
+void provaiteratoriaccessocasuale(){
+  int dati[7] = {50, 10, 40, 30, 20, 70, 60};
+  cbuffer<int> CB(5);
+  CB.enqueue_n(dati, 7);                 //40 30 20 70 60, a cavallo della fine
+  cbuffer<int>::iterator i = CB.begin();
+  bool ok = CB.end() - CB.begin() == 5 && std::distance(CB.begin(), CB.end()) == 5;
+  ok = ok && i[3] == 70 && *(i + 4) == 60 && *((i + 4) - 2) == 20 && *(CB.end() - 1) == 60;
+  ok = ok && *CB.rbegin() == 60 && *(CB.rend() - 1) == 40;
+  std::sort(CB.begin(), CB.end());       //20 30 40 60 70
+  ok = ok && CB[0] == 20 && CB[4] == 70;
+  ok = ok && *std::lower_bound(CB.begin(), CB.end(), 50) == 60;
+  std::vector<int> copia(5);
+  segmented_copy(CB, copia.begin());
+  const cbuffer<int> &CBc = CB;
+  ok = ok && segmented_equal(CBc, copia.begin()) && std::equal(CBc.begin(), CBc.end(), copia.begin());
+  cbuffer<int>::const_iterator ci = CB.begin();
+  ok = ok && ci == CB.begin() && ci + 5 == CBc.end();
+  if(ok)
+    std::cout<<"test iteratori ad accesso casuale PASSATO"<<std::endl;
+  else
+    std::cout<<"iteratori ad accesso casuale errati"<<std::endl;
+}
+
+//test spsc_cbuffer: passaggio di valori tra due thread, singoli e a blocchi
+
+void provaspsc(){
+  const int N = 100000;
+  spsc_cbuffer<int> Q(100);             //capacità arrotondata a 128
+  std::thread produttore([&Q]() {
+    int blocco[7];
+    for(int i = 0; i < N; ) {
+      if(i % 3 == 0 && i + 7 <= N) {
+        for(int j = 0; j < 7; ++j)
+          blocco[j] = i + j;
+        i += Q.try_enqueue_n(blocco, 7);
+      }
+      else if(Q.try_enqueue(i))
+        ++i;
+      else
+        std::this_thread::yield();
+    }
+  });
+  bool ok = Q.capacity() == 128;
+  int atteso = 0, fuori[5];
+  while(atteso < N) {
+    unsigned int n = Q.try_dequeue_n(fuori, 5);
+    for(unsigned int j = 0; j < n; ++j, ++atteso)
+      ok = ok && fuori[j] == atteso;
+    int v;
+    if(atteso < N && Q.try_dequeue(v))
+      ok = ok && v == atteso++;
+    if(n == 0)
+      std::this_thread::yield();
+  }
+  produttore.join();
+  spsc_cbuffer<std::string> QS(2);
+  std::string s;
+  ok = ok && QS.try_enqueue("a") && QS.try_enqueue("b") && !QS.try_enqueue("c");
+  ok = ok && QS.try_dequeue(s) && s == "a" && QS.countelem() == 1 && Q.isEmpty();
+  {
+    spsc_cbuffer<fragile> QF(4);
+    fragile sorgenti[3];
+    fragile::permesse = 3;
+    ok = ok && QF.try_enqueue_n(sorgenti, 3) == 3 && QF.try_dequeue_n(sorgenti, 3) == 3;
+    fragile::permesse = 2;                //coda in cella 3: la terza copia, nel secondo tratto, lancia
+    try {
+      QF.try_enqueue_n(sorgenti, 3);
+      ok = false;
+    }
+    catch(const std::runtime_error &) {
+    }
+    ok = ok && QF.isEmpty() && fragile::vivi == 3;
+  }
+  ok = ok && fragile::vivi == 0;
+  if(ok)
+    std::cout<<"test spsc_cbuffer PASSATO"<<std::endl;
+  else
+    std::cout<<"spsc_cbuffer errato"<<std::endl;
+}
+
+//test mpmc_cbuffer: 4 produttori e 4 consumatori, ogni valore letto una volta sola
+
+void provampmc(){
+  const int N = 20000, T = 4;
+  mpmc_cbuffer<int> Q(64);
+  std::vector<std::thread> thr;
+  std::vector<long> somme(T, 0);
+  for(int p = 0; p < T; ++p)
+    thr.push_back(std::thread([&Q, p, N]() {
+      for(int i = 0; i < N; ++i)
+        Q.enqueue(p * N + i);
+    }));
+  for(int c = 0; c < T; ++c)
+    thr.push_back(std::thread([&Q, &somme, c, N]() {
+      int v;
+      for(int i = 0; i < N; ++i) {
+        while(!Q.try_dequeue(v))
+          std::this_thread::yield();
+        somme[c] += v;
+      }
+    }));
+  for(unsigned int i = 0; i < thr.size(); ++i)
+    thr[i].join();
+  long totale = 0;
+  for(int c = 0; c < T; ++c)
+    totale += somme[c];
+  long atteso = static_cast<long>(T) * N * (T * N - 1) / 2;
+  mpmc_cbuffer<std::string> QS(2);
+  std::string s;
+  bool ok = totale == atteso && Q.isEmpty();
+  ok = ok && QS.try_enqueue("x") && QS.try_enqueue("y") && !QS.try_enqueue("z");
+  ok = ok && QS.try_dequeue(s) && s == "x" && QS.countelem() == 1;
+  if(ok)
+    std::cout<<"test mpmc_cbuffer PASSATO"<<std::endl;
+  else
+    std::cout<<"mpmc_cbuffer errato"<<std::endl;
+}
+
+//test blocking_cbuffer: timeout, attesa di spazio e risveglio a soglia
+
+void provablocking(){
+  blocking_cbuffer<int> Q(4, wait_strategy(100, 10));
+  int v = 0;
+  bool ok = !Q.dequeue_wait(v, std::chrono::milliseconds(5));  //vuoto: scade
+  Q.enqueue(1);
+  Q.enqueue(2);
+  Q.enqueue(3);
+  Q.enqueue(4);
+  ok = ok && !Q.enqueue_wait(5, std::chrono::milliseconds(5)); //pieno: scade
+  std::thread consumatore([&Q]() {
+    int x;
+    Q.dequeue_wait(x);                   //libera una cella per il produttore
+  });
+  ok = ok && Q.enqueue_wait(5, std::chrono::seconds(10));
+  consumatore.join();
+  int fuori[4];
+  ok = ok && Q.dequeue_wait_n(fuori, 4) == 4 && fuori[0] == 2 && fuori[3] == 5;
+
+  Q.set_watermark(3);
+  unsigned int letti = 0;
+  std::thread lettore([&Q, &letti, &fuori]() {
+    letti = Q.dequeue_wait_n(fuori, 4, std::chrono::seconds(10));
+  });
+  int blocco[3] = {7, 8, 9};
+  Q.enqueue(6);                          //sotto soglia: il lettore continua a dormire
+  Q.enqueue_n(blocco, 3);
+  lettore.join();
+  ok = ok && letti >= 3 && fuori[0] == 6 && Q.watermark() == 3;
+  if(ok)
+    std::cout<<"test blocking_cbuffer PASSATO"<<std::endl;
+  else
+    std::cout<<"blocking_cbuffer errato"<<std::endl;
+}
+
+//test blocking_cbuffer: un dequeue_wait_n che libera più celle sveglia tutti i produttori
+
+void provabloccoproduttori(){
+  blocking_cbuffer<int, heap_storage<int>, block_when_full> Q(4);
+  int dati[4] = {1, 2, 3, 4};
+  Q.enqueue_n(dati, 4);
+  std::thread p1([&Q]() { Q.enqueue(5); });   //buffer pieno: entrambi si addormentano
+  std::thread p2([&Q]() { Q.enqueue(6); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  int fuori[4], presi[2] = {0, 0};
+  bool ok = Q.dequeue_wait_n(fuori, 4) == 4 && fuori[0] == 1;
+  Q.set_watermark(2);
+  std::chrono::steady_clock::time_point inizio = std::chrono::steady_clock::now();
+  ok = ok && Q.dequeue_wait_n(presi, 2, std::chrono::seconds(2)) == 2;
+  ok = ok && std::chrono::steady_clock::now() - inizio < std::chrono::seconds(1);
+  p1.join();
+  p2.join();
+  ok = ok && presi[0] + presi[1] == 11 && Q.isEmpty();
+  if(ok)
+    std::cout<<"test blocking_cbuffer con più produttori PASSATO"<<std::endl;
+  else
+    std::cout<<"produttori non svegliati"<<std::endl;
+}
+
+//test vmring_storage e linearize (anche con ricaduta sullo heap)
+
+void provavmring(){
+  typedef cbuffer<int, vmring_storage<int> > ring;
+  unsigned int cap = vmring_storage<int>::round_capacity(1000);
+  ring CB(cap), CBh(1000);               //CBh: dimensione non multipla di pagina
+  bool ok = cap >= 1000 && CB.capacity() == cap && CB.storage().mirrored() && !CBh.storage().mirrored();
+  for(unsigned int i = 0; i < cap + 10; ++i)
+    CB.enqueue(static_cast<int>(i));
+  for(unsigned int i = 0; i < 1010; ++i)
+    CBh.enqueue(static_cast<int>(i));
+  ok = ok && CB.is_linearized() && !CBh.is_linearized();
+  const int *p = CB.linearize();         //nessuna copia: legge oltre la fine dell'array
+  const int *ph = CBh.linearize();       //ricaduta: elementi riportati dalla cella 0
+  for(unsigned int i = 0; ok && i < cap; ++i)
+    ok = p[i] == static_cast<int>(i + 10);
+  for(unsigned int i = 0; ok && i < 1000; ++i)
+    ok = ph[i] == static_cast<int>(i + 10) && CBh[i] == ph[i];
+
+  cbuffer<std::string> CBs(4);
+  CBs.enqueue("a");
+  CBs.enqueue("b");
+  CBs.pop();
+  CBs.enqueue("c");
+  CBs.enqueue("d");
+  CBs.enqueue("e");                      //"b" "c" "d" "e" a cavallo della fine
+  std::string *ps = CBs.linearize();
+  ok = ok && ps[0] == "b" && ps[3] == "e" && CBs[3] == "e";
+  cbuffer<int> CBc(8);
+  for(int i = 0; i < 14; ++i)            //6..13: primo tratto di 2, secondo di 6
+    CBc.enqueue(i);
+  const int *pc = CBc.linearize();
+  for(int i = 0; ok && i < 8; ++i)
+    ok = pc[i] == i + 6;
+  typedef heap_storage<std::string, pool_allocator<std::string> > pooled;
+  cbuffer_pool pool(4 * sizeof(std::string), 2);
+  pool_allocator<std::string> alloc(pool);
+  {
+    cbuffer<std::string, pooled> CBp(std::in_place, 4u, alloc);
+    for(int i = 0; i < 6; ++i)
+      CBp.enqueue(std::string(1, static_cast<char>('a' + i)));
+    std::string *pp = CBp.linearize();   //il nuovo array viene dallo stesso pool
+    ok = ok && pp[0] == "c" && pp[3] == "f" && CBp.storage().get_allocator() == alloc && pool.blocks_in_use() == 1;
+  }
+  ok = ok && pool.blocks_in_use() == 0;
+  if(ok)
+    std::cout<<"test vmring_storage e linearize PASSATO"<<std::endl;
+  else
+    std::cout<<"vmring_storage/linearize errati"<<std::endl;
+}
+
+//test mmap_storage: il contenuto sopravvive alla chiusura e viene recuperato
+
+struct evento {
+  unsigned int codice;
+  double istante;
+};
+
+void provammapstorage(){
+  typedef cbuffer<evento, mmap_storage<evento, flush_every<4> > > registro;
+  const char *percorso = "/tmp/cbuffer_prova_mmap.ring";
+  std::remove(percorso);
+  {
+    registro R(std::in_place, percorso, 8);
+    for(unsigned int i = 0; i < 11; ++i){
+      evento e = {i, i * 0.5};
+      R.enqueue(e);
+    }
+    R.pop();                             //restano 4..10
+    R.storage().flush();
+  }
+  bool ok = true;
+  {
+    registro R(std::in_place, percorso, 8);   //riapertura: nessuna copia
+    ok = R.countelem() == 7 && R[0].codice == 4 && R[6].codice == 10 && R[6].istante == 5.0;
+    registro copia(R);                   //copia in una mappatura anonima
+    ok = ok && copia.countelem() == 7 && copia[0].codice == 4;
+  }
+  try {
+    registro R(std::in_place, percorso, 16);  //capacità diversa: file non compatibile
+    ok = false;
+  }
+  catch(const std::runtime_error &) {
+  }
+  std::remove(percorso);
+  if(ok)
+    std::cout<<"test mmap_storage persistente PASSATO"<<std::endl;
+  else
+    std::cout<<"mmap_storage errato"<<std::endl;
+}
+
+//test valutazione vettoriale dei predicati (maschera, count_if, find_if, any_of)
+
+template <typename T, typename P>
+bool confrontamaschera(const cbuffer<T> &CB, P pred){
+  cbuffer_bitmask m = evaluate_mask(CB, pred);
+  unsigned int attesi = 0, primo = CB.countelem();
+  for(unsigned int i = 0; i < CB.countelem(); ++i){
+    if(m.test(i) != pred(CB[i]))
+      return false;
+    if(pred(CB[i])){
+      ++attesi;
+      if(primo == CB.countelem())
+        primo = i;
+    }
+  }
+  return m.size() == CB.countelem() && m.count() == attesi && count_if(CB, pred) == attesi &&
+         find_if(CB, pred) == primo && any_of(CB, pred) == (attesi != 0);
+}
+
+template <typename T>
+bool confrontatutti(const cbuffer<T> &CB, T v){
+  return confrontamaschera(CB, less_than(v)) && confrontamaschera(CB, less_equal(v)) &&
+         confrontamaschera(CB, greater_than(v)) && confrontamaschera(CB, greater_equal(v)) &&
+         confrontamaschera(CB, equal_to(v)) && confrontamaschera(CB, not_equal_to(v));
+}
+
+void provaevaluatemask(){
+  cbuffer<int> CBi(100);
+  cbuffer<float> CBf(100);
+  cbuffer<double> CBd(100);
+  for(int i = 0; i < 173; ++i){         //173 inserimenti: elementi su due tratti
+    CBi.enqueue((i * 37) % 101 - 50);
+    CBf.enqueue(((i * 37) % 101 - 50) * 0.5f);
+    CBd.enqueue(((i * 37) % 101 - 50) * 0.25);
+  }
+  bool ok = confrontatutti(CBi, 7) && confrontatutti(CBf, 3.5f) && confrontatutti(CBd, -1.75);
+  ok = ok && confrontamaschera(CBi, even);          //funtore qualsiasi: ramo scalare
+  ok = ok && !any_of(CBi, greater_than(1000)) && find_if(CBi, greater_than(1000)) == CBi.countelem();
+  std::vector<unsigned int> idx = evaluate_mask(CBi, equal_to(CBi[99])).indices();
+  ok = ok && !idx.empty() && idx.back() == 99;
+  cbuffer<int> vuoto(4);
+  ok = ok && evaluate_mask(vuoto, even).size() == 0 && count_if(vuoto, even) == 0;
+  if(ok)
+    std::cout<<"test maschera e count_if/find_if/any_of PASSATO"<<std::endl;
+  else
+    std::cout<<"maschera dei predicati errata"<<std::endl;
+}
+
+//test statistiche incrementali della finestra scorrevole
+
+void provaaggregating(){
+  aggregating_cbuffer<double> W(50);
+  bool ok = true;
+  for(int i = 0; i < 400 && ok; ++i){
+    W.enqueue(1e9 + ((i * 7919) % 113) * 0.01);     //valori grandi e poco dispersi
+    if(i % 5 == 0 && W.countelem() > 1)
+      W.pop();
+    double s = 0, mn = W[0], mx = W[0];
+    for(unsigned int j = 0; j < W.countelem(); ++j){
+      s += W[j];
+      mn = std::min(mn, W[j]);
+      mx = std::max(mx, W[j]);
+    }
+    double m = s / W.countelem(), v = 0;
+    for(unsigned int j = 0; j < W.countelem(); ++j)
+      v += (W[j] - m) * (W[j] - m);
+    v /= W.countelem();
+    ok = W.min() == mn && W.max() == mx && std::fabs(W.mean() - m) < 1e-6 &&
+         std::fabs(W.variance() - v) < 1e-6 && std::fabs(W.sum() - s) < 1e-3;
+  }
+  W.clear();
+  W.enqueue(3);
+  ok = ok && W.min() == 3 && W.max() == 3 && W.sum() == 3 && W.variance() == 0;
+  if(ok)
+    std::cout<<"test aggregating_cbuffer PASSATO"<<std::endl;
+  else
+    std::cout<<"statistiche della finestra errate"<<std::endl;
+}
+
+//test quantili della finestra scorrevole (esatti e ddsketch)
+
+void provaquantili(){
+  quantile_cbuffer<double> Q(200);
+  quantile_cbuffer<double, ddsketch_quantiles<double> > D(200);
+  quantile_cbuffer<double, treap_quantiles<double> > T(200);   //la politica esatta portabile
+  const double qs[] = {0.0, 0.5, 0.95, 0.99, 1.0};
+  bool ok = true;
+  for(int i = 0; i < 1000 && ok; ++i){
+    double v = 1 + ((i * 7919) % 997) * 0.37;        //latenze simulate
+    Q.enqueue(v);
+    D.enqueue(v);
+    T.enqueue(v);
+    if(i % 7 == 0 && Q.countelem() > 1){
+      Q.pop();
+      D.pop();
+      T.pop();
+    }
+    std::vector<double> copia(Q.buffer().begin(), Q.buffer().end());
+    for(unsigned int k = 0; k < 5; ++k){
+      unsigned int r = static_cast<unsigned int>(qs[k] * (copia.size() - 1));
+      std::nth_element(copia.begin(), copia.begin() + r, copia.end());
+      ok = ok && Q.quantile(qs[k]) == copia[r] && T.quantile(qs[k]) == copia[r] && std::fabs(D.quantile(qs[k]) - copia[r]) <= 0.01 * copia[r];
+    }
+  }
+  quantile_cbuffer<int> QI(50);
+  quantile_cbuffer<int, ddsketch_quantiles<int> > DI(50);
+  for(int i = 0; i < 500 && ok; ++i){
+    int v = (i * 7919) % 201 - 100;                   //negativi, zeri e positivi
+    if(i % 5 == 0)
+      v = 0;
+    QI.enqueue(v);
+    DI.enqueue(v);
+    std::vector<int> copia(QI.buffer().begin(), QI.buffer().end());
+    for(unsigned int k = 0; k < 5; ++k){
+      unsigned int r = static_cast<unsigned int>(qs[k] * (copia.size() - 1));
+      std::nth_element(copia.begin(), copia.begin() + r, copia.end());
+      ok = ok && QI.quantile(qs[k]) == copia[r] && std::abs(DI.quantile(qs[k]) - copia[r]) <= 0.02 * std::abs(copia[r]) + 1;
+    }
+  }
+  Q.clear();
+  Q.enqueue(5);
+  ok = ok && Q.median() == 5;
+  if(ok)
+    std::cout<<"test quantile_cbuffer PASSATO"<<std::endl;
+  else
+    std::cout<<"quantili della finestra errati"<<std::endl;
+}
+
+//test stampa bufferizzata e serializzazione binaria
+
+void provaserializzazione(){
+  cbuffer<int> CB(5);
+  for(int i = 1; i <= 7; ++i)           //restano 3..7, su due tratti
+    CB.enqueue(i);
+  std::ostringstream testo;
+  testo << CB;
+  cbuffer<int> vuoto(3);
+  std::ostringstream niente;
+  niente << vuoto;                      //nessuna asserzione su un buffer vuoto
+  bool ok = testo.str() == "3\n4\n5\n6\n7\n" && niente.str().empty();
+  std::stringstream bin;
+  serialize(bin, CB);
+  cbuffer<int> letto(8);
+  letto.enqueue(99);
+  deserialize(bin, letto);
+  ok = ok && bin && letto.countelem() == 5 && segmented_equal(letto, CB.begin());
+  cbuffer<int> piccolo(2);
+  std::stringstream bin2;
+  serialize(bin2, CB);
+  try {
+    deserialize(bin2, piccolo);         //5 elementi non entrano in 2 celle
+    ok = false;
+  }
+  catch(const std::runtime_error &) {
+  }
+  std::string dati = bin.str();
+  std::stringstream tronco(dati.substr(0, dati.size() - 4));
+  ok = ok && !deserialize(tronco, letto) && letto.isEmpty();
+  if(ok)
+    std::cout<<"test operator<< e serialize/deserialize PASSATO"<<std::endl;
+  else
+    std::cout<<"stampa o serializzazione errata"<<std::endl;
+}
+
+//test politica delle statistiche (contatori e istogramma dell'occupazione)
+
+void provastatistiche(){
+  typedef cbuffer<int, heap_storage<int>, counting_stats> contato_cb;
+  contato_cb C(4);
+  for(int i = 0; i < 6; ++i)            //le ultime due sovrascrivono
+    C.enqueue(i);
+  C.pop();
+  int out[2];
+  C.dequeue_n(out, 2);
+  int arr[5] = {1, 2, 3, 4, 5};
+  C.enqueue_n(arr, 5);                  //1 presente + 5: due persi
+  const counting_stats &st = C.stats();
+  bool ok = st.enqueues() == 11 && st.overwrites() == 4 && st.pops() == 3 && st.high_water() == 4;
+  C.clear();
+  ok = ok && st.drops() == 4;
+  unsigned long long campioni = 0;
+  for(unsigned int k = 0; k < counting_stats::BUCKETS; ++k)
+    campioni += st.histogram(k);
+  ok = ok && campioni == 10 && st.histogram(counting_stats::BUCKETS - 1) == 4 && st.histogram(0) == 1;
+  contato_cb copia(C);                  //la copia riparte da zero
+  ok = ok && copia.stats().enqueues() == 0;
+  std::thread monitor([&st]() {         //lettura concorrente dei contatori
+    unsigned long long visti = 0;
+    while(visti < 10011)
+      visti = st.enqueues();
+  });
+  for(int i = 0; i < 10000; ++i)
+    C.enqueue(i);
+  monitor.join();
+  contato_cb D(4), E(4), F(4);
+  D.enqueue(1);
+  D.enqueue(2);
+  E.enqueue(3);
+  F.enqueue(4);
+  D = E;                                //stessa capacità: i vecchi elementi sono sostituiti, non scartati
+  ok = ok && D.countelem() == 1 && D[0] == 3 && D.stats().drops() == 0;
+  F = std::move(D);
+  ok = ok && F[0] == 3 && F.stats().drops() == 0 && D.stats().drops() == 0;
+  ok = ok && sizeof(cbuffer<int>) == sizeof(heap_storage<int>) + 2 * sizeof(unsigned int);
+  if(ok)
+    std::cout<<"test counting_stats PASSATO"<<std::endl;
+  else
+    std::cout<<"statistiche del cbuffer errate"<<std::endl;
+}
+
+//test politiche di overflow (rifiuto, attesa, spill)
+
+void provaoverflow(){
+  cbuffer<int, heap_storage<int>, counting_stats, reject_new> R(3);
+  bool ok = R.enqueue(1) && R.enqueue(2) && R.enqueue(3) && !R.enqueue(4);
+  ok = ok && R[0] == 1 && R[2] == 3 && R.stats().drops() == 1;
+  R.pop();
+  int arr[5] = {10, 11, 12, 13, 14};
+  ok = ok && R.enqueue_n(arr, 5) == 1 && R[2] == 10 && R.stats().drops() == 5;
+  cbuffer<int, heap_storage<int>, no_stats, block_when_full> P(1);
+  ok = ok && P.enqueue(1) && !P.enqueue(2) && P[0] == 1;   //da solo non può attendere
+  std::vector<std::string> archivio;
+  typedef cbuffer<std::string, heap_storage<std::string>, no_stats,
+                  spill_oldest<std::function<void(std::string&&)> > > spill_cb;
+  spill_cb S(2);
+  S.overflow().spill = [&archivio](std::string &&s) { archivio.push_back(std::move(s)); };
+  S.enqueue("a");
+  S.enqueue("b");
+  S.enqueue("c");                       //"a" va nell'archivio
+  std::string altri[3] = {"d", "e", "f"};
+  S.enqueue_n(altri, altri + 3);        //"b", "c", "d" vanno nell'archivio
+  ok = ok && archivio.size() == 4 && archivio[0] == "a" && archivio[3] == "d" && S[0] == "e" && S[1] == "f";
+  spill_cb S2(S);                       //la copia mantiene la destinazione
+  S2.enqueue("g");
+  ok = ok && archivio.size() == 5 && archivio[4] == "e";
+  blocking_cbuffer<int, heap_storage<int>, block_when_full> B(2);
+  std::thread produttore([&B]() {
+    for(int i = 0; i < 1000; ++i)
+      B.enqueue(i);                     //attende quando il buffer è pieno
+  });
+  bool ordinati = true;
+  for(int i = 0; i < 1000; ++i){
+    int v;
+    B.dequeue_wait(v);
+    ordinati = ordinati && v == i;      //nessun valore perso
+  }
+  produttore.join();
+  if(ok && ordinati)
+    std::cout<<"test politiche di overflow PASSATO"<<std::endl;
+  else
+    std::cout<<"politiche di overflow errate"<<std::endl;
+}
+
+//test capacità variabile: reserve, resize, shrink_to_fit e crescita automatica
+
+void provacrescita(){
+  cbuffer<int> C(4);
+  for(int i = 0; i < 6; ++i)            //restano 2..5, su due tratti
+    C.enqueue(i);
+  C.reserve(10);
+  bool ok = C.capacity() == 10 && C.countelem() == 4 && C.is_linearized() && C.array_one().first[0] == 2;
+  C.enqueue(6);
+  ok = ok && C.countelem() == 5 && C[4] == 6;
+  C.resize(3);                          //restano i 3 più recenti
+  ok = ok && C.capacity() == 3 && C.countelem() == 3 && C[0] == 4 && C[2] == 6;
+  C.pop();
+  C.shrink_to_fit();
+  ok = ok && C.capacity() == 2 && C[0] == 5 && C[1] == 6;
+  cbuffer<int, pow2_storage<int> > P(3);
+  P.reserve(5);
+  ok = ok && P.capacity() == 8;
+  cbuffer<int, pow2_storage<int>, counting_stats> Q(4);
+  for(int i = 0; i < 6; ++i)            //restano 2..5
+    Q.enqueue(i);
+  const int *celle = Q.array_two().first;
+  Q.resize(3);                          //arrotondata a 4: nessuna riallocazione, nessuno scartato
+  ok = ok && Q.capacity() == 4 && Q.countelem() == 4 && Q[0] == 2 && Q.array_two().first == celle && Q.stats().drops() == 0;
+  Q.pop();
+  Q.shrink_to_fit();                    //3 elementi richiedono comunque 4 celle
+  ok = ok && Q.capacity() == 4 && Q.array_two().first == celle;
+  Q.resize(2);
+  ok = ok && Q.capacity() == 2 && Q.countelem() == 2 && Q[0] == 4 && Q[1] == 5 && Q.stats().drops() == 1;
+  cbuffer<int, pow2_storage<int> > R(16);
+  for(int i = 0; i < 7; ++i)
+    R.enqueue(i);
+  R.resize(5);                          //arrotondata a 8: restano tutti e 7
+  ok = ok && R.capacity() == 8 && R.countelem() == 7 && R[0] == 0 && R[6] == 6;
+  int copie = contato::copie;
+  {
+    cbuffer<contato, heap_storage<contato>, counting_stats, grow_when_full<3, 2> > G(2);
+    for(int i = 0; i < 20; ++i)
+      G.emplace(i);
+    G.enqueue(G[0]);                    //il valore arriva dal buffer stesso
+    ok = ok && G.countelem() == 21 && G[0].valore == 0 && G[19].valore == 19 && G[20].valore == 0;
+    ok = ok && G.stats().overwrites() == 0 && G.capacity() >= 21;
+    contato arr[1] = {contato(7)};
+    G.enqueue_n(arr, arr + 1);
+    ok = ok && G[21].valore == 7;
+  }
+  ok = ok && contato::copie - copie == 2 && contato::vivi == 0;   //solo le due copie richieste: le crescite spostano
+  cbuffer<int, heap_storage<int>, no_stats, grow_when_full<> > V;
+  int dati[5] = {1, 2, 3, 4, 5};
+  V.enqueue_n(dati, 5);
+  ok = ok && V.countelem() == 5 && V[4] == 5;
+  if(ok)
+    std::cout<<"test reserve/resize e grow_when_full PASSATO"<<std::endl;
+  else
+    std::cout<<"capacità variabile errata"<<std::endl;
+}
+
+//test confronti: operator==/!= a tratti e confronto lessicografico
+
+void provaconfronti(){
+  cbuffer<int> A(5), B(8);
+  for(int i = 0; i < 8; ++i)            //A: 3..7 con il giro dell'array
+    A.enqueue(i);
+  for(int i = 3; i < 8; ++i)            //B: 3..7 contigui, capacità diversa
+    B.enqueue(i);
+  bool ok = A == B && !(A != B) && !A.equals(B) && compare(A, B) == 0;
+  B.pop();
+  B.enqueue(7);                         //B: 4..7,7 -> A < B
+  ok = ok && A != B && A < B && B > A && A <= B && compare(B, A) > 0;
+  cbuffer<int> C(A);
+  C.pop();                              //C: 4..7
+  ok = ok && C != A && compare(A, C) < 0;
+  cbuffer<int> D(5);
+  for(int i = 3; i < 7; ++i)            //D: 3..6, prefisso di A
+    D.enqueue(i);
+  ok = ok && D < A && D != A && A.equals(A);
+  cbuffer<double> E(3), F(3);
+  E.enqueue(0.0);
+  F.enqueue(-0.0);                      //rappresentazioni diverse ma uguali: std::equal
+  ok = ok && E == F;
+  cbuffer<double> N(3);
+  F.clear();
+  N.enqueue(std::nan(""));              //NaN, 1 contro NaN, 2: il NaN non decide
+  N.enqueue(1.0);
+  F.enqueue(std::nan(""));
+  F.enqueue(2.0);
+  ok = ok && compare(N, F) < 0 && N < F && !(F < N) &&
+       std::lexicographical_compare(N.begin(), N.end(), F.begin(), F.end());
+  cbuffer<course> G(2), H(2);
+  G.enqueue(course(4, "ING"));
+  H.enqueue(course(4, "ING"));
+  ok = ok && G == H && G.equals(H);
+  if(ok)
+    std::cout<<"test operator== e confronto lessicografico PASSATO"<<std::endl;
+  else
+    std::cout<<"confronti errati"<<std::endl;
+}
+
+//test allocatori: pool di blocchi condiviso tra copie e pagine grandi legate al nodo NUMA
+
+void provaallocatori(){
+  cbuffer_pool pool(16 * sizeof(int), 4);
+  pool_allocator<int> alloc(pool);
+  typedef cbuffer<int, heap_storage<int, pool_allocator<int> > > pooled;
+  bool ok = true;
+  {
+    std::vector<pooled> V;
+    for(int i = 0; i < 10; ++i) {
+      V.push_back(pooled(std::in_place, 16u, alloc));
+      V.back().enqueue(i);
+    }
+    ok = ok && pool.blocks_in_use() == 10 && pool.slabs() == 3 && V[7][0] == 7;
+    pooled C(V[3]);                       //la copia usa lo stesso pool
+    ok = ok && C.storage().get_allocator() == alloc && pool.blocks_in_use() == 11 && C[0] == 3;
+    C.reserve(100);                       //oltre il blocco: operator new
+    ok = ok && pool.blocks_in_use() == 10 && C[0] == 3 && C.storage().get_allocator() == alloc;
+  }
+  ok = ok && pool.blocks_in_use() == 0;
+  cbuffer<double, pow2_storage<double, hugepage_allocator<double> > >
+    H(std::in_place, 1000u, hugepage_allocator<double>(current_numa_node()));
+  for(int i = 0; i < 1500; ++i)
+    H.enqueue(i);
+  ok = ok && H.capacity() == 1024 && H[0] == 476 && H.storage().get_allocator().numa_node() == current_numa_node();
+  if(ok)
+    std::cout<<"test allocatori (pool e pagine grandi) PASSATO"<<std::endl;
+  else
+    std::cout<<"allocatori errati"<<std::endl;
+}
+
+//test consumazione sul posto: consume_up_to e drain a tratti contigui
+
+void provadrain(){
+  cbuffer<int, heap_storage<int>, counting_stats> C(8);
+  for(int i = 0; i < 12; ++i)           //restano 4..11, su due tratti
+    C.enqueue(i);
+  int somma = 0, chiamate = 0;
+  unsigned int tolti = C.consume_up_to(6, [&](int *p, unsigned int n) {
+    ++chiamate;
+    for(unsigned int i = 0; i < n; ++i)
+      somma += p[i];
+  });
+  bool ok = tolti == 6 && chiamate == 2 && somma == 4+5+6+7+8+9 && C.countelem() == 2 && C[0] == 10;
+  ok = ok && C.stats().pops() == 6;
+  for(int i = 12; i < 18; ++i)
+    C.enqueue(i);
+  tolti = C.drain([](int *p, unsigned int n) -> unsigned int {   //si ferma al primo dispari dopo la testa
+    for(unsigned int i = 1; i < n; ++i)
+      if(p[i] % 2 != 0)
+        return i;
+    return n;
+  });
+  ok = ok && tolti == 1 && C[0] == 11;
+  tolti = C.drain([](int *, unsigned int) { return false; });  //solo il primo tratto
+  ok = ok && tolti != 0 && tolti < 7 && C.countelem() == 7 - tolti;
+  tolti = C.drain([](int *, unsigned int) {});
+  ok = ok && C.isEmpty() && C.stats().pops() == 14;
+  {
+    cbuffer<contato> D(4);
+    for(int i = 0; i < 6; ++i)
+      D.emplace(i);
+    try {
+      D.drain([](contato *p, unsigned int) {
+        if(p->valore == 4)                //secondo tratto: celle 0 e 1
+          throw std::runtime_error("stop");
+      });
+    }
+    catch(const std::runtime_error &) {
+    }
+    ok = ok && D.countelem() == 2 && D[0].valore == 4;
+  }
+  ok = ok && contato::vivi == 0;
+  if(ok)
+    std::cout<<"test drain e consume_up_to PASSATO"<<std::endl;
+  else
+    std::cout<<"consumazione sul posto errata"<<std::endl;
+}
+
+//test sharded_cbuffer: scrittori concorrenti, fusione in ordine di marca e rilascio degli shard
+
+void provasharded(){
+  const int N = 5000, T = 4;
+  sharded_cbuffer<int, sequence_stamp> S(T, 64);
+  std::vector<std::thread> thr;
+  for(int p = 0; p < T; ++p)
+    thr.push_back(std::thread([&S, p, N]() {
+      sharded_cbuffer<int, sequence_stamp>::writer w = S.attach();
+      for(int i = 0; i < N; ++i)
+        while(!w.record(p * N + i))       //shard pieno: si riprova
+          std::this_thread::yield();
+    }));
+  std::vector<stamped<int> > tutti, parziale;
+  std::vector<int> prossimo(T, 0);
+  bool ok = true;
+  while(tutti.size() < static_cast<std::size_t>(T * N)) {
+    parziale.clear();
+    if(S.drain_ordered(parziale) == 0)
+      std::this_thread::yield();
+    for(std::size_t i = 0; i < parziale.size(); ++i) {
+      int p = parziale[i].value / N;
+      ok = ok && parziale[i].value % N == prossimo[p]++;   //ordine di ciascuno scrittore
+      ok = ok && (i == 0 || parziale[i - 1].stamp < parziale[i].stamp);
+    }
+    tutti.insert(tutti.end(), parziale.begin(), parziale.end());
+  }
+  for(unsigned int i = 0; i < thr.size(); ++i)
+    thr[i].join();
+  ok = ok && S.countelem() == 0 && prossimo == std::vector<int>(T, N);
+  sharded_cbuffer<std::string> L(1, 2);
+  sharded_cbuffer<std::string>::writer w = L.attach();
+  ok = ok && w.record("a") && w.record(3, 'b') && !w.record("c") && L.drops() == 1;
+  try {
+    L.attach();
+    ok = false;
+  }
+  catch(const std::runtime_error &) {
+  }
+  std::vector<stamped<std::string> > v;
+  ok = ok && L.drain_ordered(v) == 2 && v[0].value == "a" && v[1].value == "bbb" && v[0].stamp <= v[1].stamp;
+  ok = ok && L.drain_ordered(v) == 0 && v.size() == 2;   //gli elementi letti non restano negli shard
+  w.record("d");
+  w.release();
+  {
+    sharded_cbuffer<std::string>::writer w2 = L.attach();   //lo shard rilasciato torna disponibile
+    ok = ok && w2.record("e");
+  }
+  ok = ok && L.drain_ordered(v) == 2 && v[2].value == "d" && v[3].value == "e";
+  sharded_cbuffer<int, sequence_stamp> R(2, 1024);
+  std::vector<std::thread> turni;
+  for(int p = 0; p < T; ++p)                //più thread che shard: si riprova finché uno si libera
+    turni.push_back(std::thread([&R]() {
+      for(int k = 0; k < 50; ++k)
+        for(;;) {
+          try {
+            sharded_cbuffer<int, sequence_stamp>::writer w = R.attach();
+            w.record(k);
+            break;
+          }
+          catch(const std::runtime_error &) {
+            std::this_thread::yield();
+          }
+        }
+    }));
+  for(unsigned int i = 0; i < turni.size(); ++i)
+    turni[i].join();
+  std::vector<stamped<int> > r;
+  ok = ok && R.drain_ordered(r) == static_cast<unsigned int>(T * 50) && R.drops() == 0;
+  if(ok)
+    std::cout<<"test sharded_cbuffer PASSATO"<<std::endl;
+  else
+    std::cout<<"sharded_cbuffer errato"<<std::endl;
+}
+
+//test cbuffer_soa: record a colonne e kernel sulle singole colonne
+
+void provasoa(){
+  cbuffer_soa<double, int, long> S(4);
+  for(int i = 0; i < 6; ++i)            //restano i record 2..5, su due tratti
+    S.enqueue(std::make_tuple(i * 1.5, i, 100L * i));
+  bool ok = S.countelem() == 4 && S.isFull() && S[0] == std::make_tuple(3.0, 2, 200L);
+  cbuffer_column<int> Q = S.column<1>();
+  ok = ok && Q.countelem() == 4 && Q[0] == 2 && Q[3] == 5;
+  ok = ok && Q.array_one().second == 2 && Q.array_one().first[0] == 2 && Q.array_two().second == 2 && Q.array_two().first[0] == 4;
+  ok = ok && count_if(Q, greater_than(3)) == 2 && find_if(S.column<0>(), greater_equal(6.0)) == 2;
+  ok = ok && !any_of(S.column<2>(), [](long v) { return v > 500; });
+  cbuffer_bitmask m = evaluate_mask(S.column<0>(), less_than(5.0));
+  ok = ok && m.size() == 4 && m.test(0) && m.test(1) && !m.test(2);
+  S.get<2>(1) = 7;
+  S.emplace(9.0, 9, 900L);
+  ok = ok && S.get<2>(0) == 7 && S[3] == std::make_tuple(9.0, 9, 900L);
+  cbuffer_soa<double, int, long> C(S);
+  S.pop();
+  ok = ok && S.countelem() == 3 && C.countelem() == 4 && C.get<1>(0) == 3 && C.column<1>()[3] == 9;
+  cbuffer_soa<double, int, long> M(std::move(C));
+  ok = ok && M.countelem() == 4 && C.capacity() == 0 && M[0] == std::make_tuple(4.5, 3, 7L);
+  if(ok)
+    std::cout<<"test cbuffer_soa PASSATO"<<std::endl;
+  else
+    std::cout<<"cbuffer_soa errato"<<std::endl;
+}
+
 //nel main semplicemente richiamo tutti i test
 
 int main() {
@@ -157,4 +1259,31 @@ int main() {
   provaoperazionidibaseconcustom();
   provaaccessooperatorieoutput();
   provaevaluateif();
+  provaindicipow2();
+  provafixedcbuffer();
+  provaemplaceedistruzioni();
+  provaaccodaelemento();
+  provamoveecopia();
+  provaenqueuendequeuen();
+  provaenqueuenstesso();
+  provaarrayoneetwo();
+  provaiteratoriaccessocasuale();
+  provaspsc();
+  provampmc();
+  provablocking();
+  provabloccoproduttori();
+  provavmring();
+  provammapstorage();
+  provaevaluatemask();
+  provaaggregating();
+  provaquantili();
+  provaserializzazione();
+  provastatistiche();
+  provaoverflow();
+  provacrescita();
+  provaconfronti();
+  provaallocatori();
+  provadrain();
+  provasharded();
+  provasoa();
 }
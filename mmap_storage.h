@@ -0,0 +1,274 @@
+#ifndef MMAP_STORAGE_H
+#define MMAP_STORAGE_H
+
+#include "cbuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, msync
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // ftruncate, close
+/**
+@file mmap_storage.h
+@brief Politica di memorizzazione persistente mmap_storage (POSIX)
+**/
+
+/**
+Politica di scrittura su disco: nessun msync, i dati arrivano al file
+tramite la page cache e sopravvivono alla terminazione del processo
+(non a un crash del sistema)
+**/
+struct no_flush {
+  void on_update(void *, std::size_t) {
+  }
+};
+
+/**
+Politica di scrittura su disco: msync asincrono ogni N aggiornamenti dello
+stato (N = 1: dopo ogni operazione)
+**/
+template <unsigned int N>
+struct flush_every {
+  unsigned int pending;
+
+  flush_every() : pending(0) {
+  }
+
+  void on_update(void *base, std::size_t len) {
+    if(++pending >= N) {
+      pending = 0;
+      ::msync(base, len, MS_ASYNC);
+    }
+  }
+};
+
+/**
+Politica di memorizzazione persistente: un'intestazione con capacità e
+stato degli indici e l'array degli elementi vivono in un file mappato in
+memoria. Un enqueue costa quanto con heap_storage più una scrittura di
+8 byte nell'intestazione: testa e conteggio vengono salvati insieme con una
+sola scrittura atomica, quindi chi rilegge l'intestazione trova sempre una
+coppia scritta dalla stessa chiamata.
+L'ordine tra elementi e intestazione vale solo in memoria (per il processo
+e per chi mappa lo stesso file): se termina il processo, la sovrascrittura
+a buffer pieno può lasciare il nuovo valore al posto del più vecchio con
+gli indici precedenti, perché la cella viene scritta prima che la testa
+avanzi. Le pagine invece arrivano su disco in un ordine qualsiasi: con
+no_flush o flush_every (MS_ASYNC) la pagina dell'intestazione può
+precedere quella degli elementi, quindi dopo un crash del sistema gli
+indici possono riferirsi a celle non aggiornate. flush() (msync sincrono)
+dà un punto di ripristino coerente.
+Riaprendo il file con cbuffer(std::in_place, path, size) il contenuto
+viene recuperato senza letture o copie.
+Il costruttore con la sola dimensione (usato da copie e temporanei) crea
+una mappatura anonima, non legata a un file.
+@tparam Flush politica di msync (no_flush o flush_every<N>)
+**/
+template <typename T, typename Flush = no_flush>
+class mmap_storage {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "mmap_storage richiede T banalmente copiabile");
+
+public:
+  typedef unsigned int size_type;
+
+  mmap_storage() : _base(0), _bytes(0), _header(0), _data(0), _capacity(0) {
+  }
+
+  /**
+  @brief Mappatura anonima di size celle (non persistente)
+  **/
+  explicit mmap_storage(size_type size) : _base(0), _bytes(0), _header(0), _data(0), _capacity(0) {
+    if(size == 0)
+      return;
+    map(-1, size);
+    init_header(size);
+  }
+
+  /**
+  @brief Apre (o crea) il file path con size celle
+  Se il file esiste già deve essere stato creato con la stessa capacità e
+  lo stesso tipo di elemento.
+  @param path percorso del file
+  @param size numero di celle
+  @throw std::runtime_error se il file non si può aprire o non è compatibile
+  **/
+  mmap_storage(const char *path, size_type size) : _base(0), _bytes(0), _header(0), _data(0), _capacity(0) {
+    int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0)
+      throw std::runtime_error(std::string("mmap_storage: impossibile aprire ") + path);
+    struct stat st;
+    bool nuovo = ::fstat(fd, &st) == 0 && st.st_size == 0;
+    std::size_t bytes = total_bytes(size);
+    if(nuovo && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+      ::close(fd);
+      throw std::runtime_error(std::string("mmap_storage: impossibile dimensionare ") + path);
+    }
+    if(!nuovo && static_cast<std::size_t>(st.st_size) != bytes) {
+      ::close(fd);
+      throw std::runtime_error(std::string("mmap_storage: dimensione non compatibile in ") + path);
+    }
+    try {
+      map(fd, size);
+    }
+    catch(...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+    if(nuovo)
+      init_header(size);
+    else if(_header->magic != MAGIC || _header->elem_size != sizeof(T) || _header->capacity != size) {
+      unmap();
+      throw std::runtime_error(std::string("mmap_storage: intestazione non compatibile in ") + path);
+    }
+  }
+
+  ~mmap_storage() {
+    unmap();
+  }
+
+  T *data() {
+    return _data;
+  }
+
+  const T *data() const {
+    return _data;
+  }
+
+  size_type capacity() const {
+    return _capacity;
+  }
+
+  static bool mirrored() {
+    return false;
+  }
+
+  size_type wrap(size_type i) const {
+    return i >= _capacity ? i - _capacity : i;
+  }
+
+  size_type mod(std::size_t seq) const {
+    return static_cast<size_type>(seq % _capacity);
+  }
+
+  /**
+  @brief Legge dall'intestazione lo stato salvato degli indici
+  Uno stato non valido (file danneggiato) viene scartato: il buffer riparte vuoto.
+  **/
+  void load_state(size_type &f, size_type &n) const {
+    f = 0;
+    n = 0;
+    if(_header == 0)
+      return;
+    std::uint64_t state = __atomic_load_n(&_header->state, __ATOMIC_ACQUIRE);
+    size_type sf = static_cast<size_type>(state >> 32);
+    size_type sn = static_cast<size_type>(state);
+    if(sf < _capacity && sn <= _capacity) {
+      f = sf;
+      n = sn;
+    }
+  }
+
+  /**
+  @brief Salva nell'intestazione testa e conteggio con una sola scrittura atomica
+  La scrittura è un release, ordinata dopo quella dell'elemento per chi legge
+  con acquire (load_state); non vincola l'ordine in cui le pagine arrivano al file.
+  **/
+  void store_state(size_type f, size_type n) {
+    if(_header == 0)
+      return;
+    __atomic_store_n(&_header->state, (static_cast<std::uint64_t>(f) << 32) | n, __ATOMIC_RELEASE);
+    _flush.on_update(_base, _bytes);
+  }
+
+  /**
+  @brief Forza la scrittura sincrona su disco di intestazione ed elementi
+  **/
+  void flush() const {
+    if(_base != 0)
+      ::msync(_base, _bytes, MS_SYNC);
+  }
+
+  static const bool pointer_swap = true; ///< swap scambia solo i puntatori
+  static const bool growable = false; ///< la mappatura è legata al file e alla sua capacità
+
+  void swap(mmap_storage &other) {
+    std::swap(_base, other._base);
+    std::swap(_bytes, other._bytes);
+    std::swap(_header, other._header);
+    std::swap(_data, other._data);
+    std::swap(_capacity, other._capacity);
+    std::swap(_flush, other._flush);
+  }
+
+private:
+  mmap_storage(const mmap_storage &);
+  mmap_storage &operator=(const mmap_storage &);
+
+  static const std::uint64_t MAGIC = 0x3152464655424243ull; ///< "CBBUFFR1"
+
+  // Intestazione all'inizio del file
+  struct header {
+    std::uint64_t magic;
+    std::uint32_t elem_size;
+    std::uint32_t capacity;
+    std::uint64_t state; ///< (first << 32) | nelem
+  };
+
+  // Gli elementi iniziano dopo l'intestazione, allineati per T
+  static std::size_t data_offset() {
+    return alignof(T) > 64 ? alignof(T) : 64;
+  }
+
+  static std::size_t total_bytes(size_type size) {
+    return data_offset() + static_cast<std::size_t>(size) * sizeof(T);
+  }
+
+  // Mappa il file fd (o memoria anonima se fd < 0) con spazio per size celle
+  void map(int fd, size_type size) {
+    std::size_t bytes = total_bytes(size);
+    void *p;
+    if(fd < 0)
+      p = ::mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    else
+      p = ::mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+      throw std::runtime_error("mmap_storage: mmap fallita");
+    _base = p;
+    _bytes = bytes;
+    _header = static_cast<header*>(p);
+    _data = reinterpret_cast<T*>(static_cast<char*>(p) + data_offset());
+    _capacity = size;
+  }
+
+  void init_header(size_type size) {
+    _header->magic = MAGIC;
+    _header->elem_size = sizeof(T);
+    _header->capacity = size;
+    _header->state = 0;
+  }
+
+  void unmap() {
+    if(_base != 0)
+      ::munmap(_base, _bytes);
+    _base = 0;
+    _bytes = 0;
+    _header = 0;
+    _data = 0;
+    _capacity = 0;
+  }
+
+  void *_base; ///< Inizio della mappatura
+  std::size_t _bytes; ///< Dimensione della mappatura
+  header *_header; ///< Intestazione (inizio della mappatura)
+  T *_data; ///< Prima cella
+  size_type _capacity; ///< Numero di celle
+  Flush _flush; ///< Politica di msync
+};
+
+#endif
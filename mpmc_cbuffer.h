@@ -0,0 +1,180 @@
+#ifndef MPMC_CBUFF_H
+#define MPMC_CBUFF_H
+
+#include "spsc_cbuffer.h" // cbuffer_cache_line
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+/**
+@file mpmc_cbuffer.h
+@brief Dichiarazione della classe mpmc_cbuffer
+**/
+
+/**
+Buffer circolare limitato lock-free per più produttori e più consumatori.
+Ogni cella ha un numero di sequenza: un produttore che ha prenotato la
+posizione pos può scrivere quando seq == pos, un consumatore può leggere
+quando seq == pos + 1. Produttori e consumatori si contendono solo il
+proprio contatore con una compare-and-swap, senza lock.
+Le celle stanno in un pow2_storage, così la cella di una posizione si
+ottiene con una maschera. Come spsc_cbuffer, quando il buffer è pieno
+non sovrascrive: try_enqueue fallisce ed enqueue attende una cella libera.
+**/
+template <typename T>
+class mpmc_cbuffer {
+public:
+  typedef unsigned int size_type;
+  typedef T value_type;
+
+  /**
+  @brief Costruttore
+  @param size numero di celle richieste (arrotondato alla potenza di due successiva)
+  **/
+  explicit mpmc_cbuffer(size_type size)
+  : _storage(size < 2 ? 2 : size), _enqueue_pos(0), _dequeue_pos(0) {
+    for(size_type i = 0; i < _storage.capacity(); ++i)
+      ::new (static_cast<void*>(_storage.data() + i)) cell(i);
+  }
+
+  /**
+  @brief Distruttore. Distrugge gli elementi non ancora consumati e le celle.
+  **/
+  ~mpmc_cbuffer() {
+    std::size_t h = _dequeue_pos.load(std::memory_order_relaxed);
+    std::size_t t = _enqueue_pos.load(std::memory_order_relaxed);
+    for(; h != t; ++h)
+      _storage.data()[_storage.mod(h)].value()->~T();
+    for(size_type i = 0; i < _storage.capacity(); ++i)
+      _storage.data()[i].~cell();
+  }
+
+  size_type capacity() const {
+    return _storage.capacity();
+  }
+
+  /**
+  @brief Numero di elementi presenti (istantanea, può essere già superata)
+  **/
+  size_type countelem() const {
+    std::size_t t = _enqueue_pos.load(std::memory_order_acquire);
+    std::size_t h = _dequeue_pos.load(std::memory_order_acquire);
+    return t > h ? static_cast<size_type>(t - h) : 0;
+  }
+
+  bool isEmpty() const {
+    return countelem() == 0;
+  }
+
+  /**
+  @brief Accoda un valore attendendo (senza lock) che si liberi una cella
+  @param value valore da accodare
+  @return true
+  **/
+  bool enqueue(const T &value) {
+    while(!try_emplace(value))
+      std::this_thread::yield();
+    return true;
+  }
+
+  bool enqueue(T &&value) {
+    while(!try_emplace(std::move(value)))
+      std::this_thread::yield();
+    return true;
+  }
+
+  /**
+  @brief Accoda un valore se c'è una cella libera
+  @param value valore da accodare
+  @return false se il buffer è pieno
+  **/
+  bool try_enqueue(const T &value) {
+    return try_emplace(value);
+  }
+
+  bool try_enqueue(T &&value) {
+    return try_emplace(std::move(value));
+  }
+
+  /**
+  @brief Costruisce un elemento in coda se c'è una cella libera
+  @param args argomenti per il costruttore di T
+  @return false se il buffer è pieno
+  **/
+  template <typename... Args>
+  bool try_emplace(Args&&... args) {
+    std::size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+    cell *c;
+    for(;;) {
+      c = _storage.data() + _storage.mod(pos);
+      std::size_t seq = c->seq.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if(diff == 0) {
+        if(_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if(diff < 0)   //la cella contiene ancora un valore di un giro precedente
+        return false;
+      else
+        pos = _enqueue_pos.load(std::memory_order_relaxed);
+    }
+    ::new (static_cast<void*>(c->raw)) T(std::forward<Args>(args)...);
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+  @brief Toglie un elemento spostandolo in out
+  @param out destinazione del valore
+  @return false se il buffer è vuoto
+  **/
+  bool try_dequeue(T &out) {
+    std::size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+    cell *c;
+    for(;;) {
+      c = _storage.data() + _storage.mod(pos);
+      std::size_t seq = c->seq.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if(diff == 0) {
+        if(_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if(diff < 0)   //nessun produttore ha ancora scritto questa cella
+        return false;
+      else
+        pos = _dequeue_pos.load(std::memory_order_relaxed);
+    }
+    T *value = c->value();
+    out = std::move(*value);
+    value->~T();
+    c->seq.store(pos + capacity(), std::memory_order_release);
+    return true;
+  }
+
+private:
+  mpmc_cbuffer(const mpmc_cbuffer &);
+  mpmc_cbuffer &operator=(const mpmc_cbuffer &);
+
+  // Cella: numero di sequenza e spazio non inizializzato per un T
+  struct cell {
+    std::atomic<std::size_t> seq;
+    alignas(T) unsigned char raw[sizeof(T)];
+
+    explicit cell(std::size_t s) : seq(s) {
+    }
+
+    T *value() {
+      return reinterpret_cast<T*>(raw);
+    }
+  };
+
+  pow2_storage<cell> _storage; ///< Celle (in sola lettura dopo la costruzione)
+
+  alignas(cbuffer_cache_line) std::atomic<std::size_t> _enqueue_pos; ///< Prossima posizione dei produttori
+  alignas(cbuffer_cache_line) std::atomic<std::size_t> _dequeue_pos; ///< Prossima posizione dei consumatori
+};
+
+#endif
@@ -0,0 +1,459 @@
+#ifndef QUANTILE_CBUFF_H
+#define QUANTILE_CBUFF_H
+
+#include "cbuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#ifdef __GLIBCXX__
+#include <ext/pb_ds/assoc_container.hpp> // __gnu_pbds::tree
+#include <ext/pb_ds/tree_policy.hpp>
+#endif
+/**
+@file quantile_cbuffer.h
+@brief Dichiarazione della classe quantile_cbuffer e delle politiche dei quantili
+**/
+
+/**
+Politica dei quantili esatta e portabile: treap (albero di ricerca con
+priorità casuali) in cui ogni nodo conosce la dimensione del suo
+sottoalbero, quindi il rango di ogni elemento. Inserimento, rimozione e
+quantile costano O(log N) attesi. I nodi stanno in un vettore con una
+lista dei liberi: a finestra piena non si alloca nulla. Con valori uguali
+la rimozione toglie uno qualsiasi di essi.
+È exact_quantiles fuori da libstdc++; con libstdc++ l'albero di __gnu_pbds
+è da due a tre volte più veloce.
+**/
+template <typename T>
+class treap_quantiles {
+public:
+  typedef unsigned int size_type;
+
+  explicit treap_quantiles(size_type size = 0) : _root(nil), _free(nil), _seed(2463534242u) {
+    _nodes.reserve(size);
+  }
+
+  void insert(const T &value) {
+    size_type n = make_node(value);
+    // si scende finché i nodi hanno priorità maggiore del nuovo, poi il
+    // sottoalbero rimasto viene diviso tra i due figli del nuovo nodo
+    size_type *link = &_root;
+    while(*link != nil && _nodes[*link].priority > _nodes[n].priority) {
+      node &c = _nodes[*link];
+      ++c.size;
+      link = value < c.value ? &c.left : &c.right;
+    }
+    split(*link, value, _nodes[n].left, _nodes[n].right);
+    update(n);
+    *link = n;
+  }
+
+  /**
+  @pre value è presente
+  **/
+  void erase(const T &value) {
+    size_type *link = &_root;
+    for(;;) {
+      assert(*link != nil);
+      node &c = _nodes[*link];
+      if(value < c.value)
+        link = &c.left;
+      else if(c.value < value)
+        link = &c.right;
+      else
+        break;
+      --c.size;
+    }
+    size_type t = *link;
+    *link = merge(_nodes[t].left, _nodes[t].right);
+    _nodes[t].left = _free;
+    _free = t;
+  }
+
+  void clear() {
+    _nodes.clear();
+    _root = nil;
+    _free = nil;
+  }
+
+  /**
+  @brief Elemento di rango rank (0 = minimo)
+  @pre rank minore del numero di elementi
+  **/
+  T at_rank(size_type rank) const {
+    size_type t = _root;
+    for(;;) {
+      assert(t != nil);
+      size_type left = count(_nodes[t].left);
+      if(rank < left)
+        t = _nodes[t].left;
+      else if(rank == left)
+        return _nodes[t].value;
+      else {
+        rank -= left + 1;
+        t = _nodes[t].right;
+      }
+    }
+  }
+
+private:
+  static const size_type nil = static_cast<size_type>(-1);
+
+  // Nodi ordinati per valore e, a parità di valore, per inserimento: così
+  // i valori uguali non formano una catena e l'albero resta bilanciato
+  struct node {
+    T value;
+    std::uint32_t priority; ///< Un nodo ha priorità maggiore dei suoi figli
+    size_type left;
+    size_type right;
+    size_type size; ///< Nodi del sottoalbero, compreso questo
+  };
+
+  size_type count(size_type t) const {
+    return t == nil ? 0 : _nodes[t].size;
+  }
+
+  void update(size_type t) {
+    _nodes[t].size = 1 + count(_nodes[t].left) + count(_nodes[t].right);
+  }
+
+  size_type make_node(const T &value) {
+    _seed ^= _seed << 13;   // xorshift32
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    node n = {value, _seed, nil, nil, 1};
+    if(_free == nil) {
+      _nodes.push_back(n);
+      return static_cast<size_type>(_nodes.size() - 1);
+    }
+    size_type i = _free;
+    _free = _nodes[i].left;
+    _nodes[i] = n;
+    return i;
+  }
+
+  // Divide t in l (valori non maggiori di value) e r (gli altri): il nuovo
+  // nodo segue tutti quelli uguali già presenti
+  void split(size_type t, const T &value, size_type &l, size_type &r) {
+    if(t == nil) {
+      l = r = nil;
+      return;
+    }
+    if(!(value < _nodes[t].value)) {
+      split(_nodes[t].right, value, _nodes[t].right, r);
+      l = t;
+    }
+    else {
+      split(_nodes[t].left, value, l, _nodes[t].left);
+      r = t;
+    }
+    update(t);
+  }
+
+  // Unisce a e b, con tutti i valori di a non maggiori di quelli di b
+  size_type merge(size_type a, size_type b) {
+    if(a == nil)
+      return b;
+    if(b == nil)
+      return a;
+    if(_nodes[a].priority > _nodes[b].priority) {
+      _nodes[a].right = merge(_nodes[a].right, b);
+      update(a);
+      return a;
+    }
+    _nodes[b].left = merge(a, _nodes[b].left);
+    update(b);
+    return b;
+  }
+
+  std::vector<node> _nodes; ///< Nodi dell'albero e nodi liberi
+  size_type _root; ///< Radice (nil se vuoto)
+  size_type _free; ///< Primo nodo libero, i successivi collegati da left
+  std::uint32_t _seed; ///< Stato del generatore delle priorità
+};
+
+#ifdef __GLIBCXX__
+
+/**
+Politica dei quantili esatta: albero d'ordine (__gnu_pbds con
+tree_order_statistics_node_update) che conosce il rango di ogni nodo.
+Inserimento, rimozione e quantile costano O(log N), quindi anche con
+finestre grandi e molti inserimenti tra una query e l'altra il costo per
+elemento resta logaritmico. I valori uguali si distinguono con un numero
+di sequenza; la rimozione toglie uno qualsiasi dei valori uguali.
+__gnu_pbds esiste solo con libstdc++: altrove exact_quantiles è
+treap_quantiles, con la stessa interfaccia e le stesse complessità attese.
+**/
+template <typename T>
+class exact_quantiles {
+public:
+  typedef unsigned int size_type;
+
+  explicit exact_quantiles(size_type size = 0) : _seq(0) {
+    (void)size;
+  }
+
+  void insert(const T &value) {
+    _tree.insert(key(value, _seq++));
+  }
+
+  void erase(const T &value) {
+    typename tree_type::iterator i = _tree.lower_bound(key(value, 0));
+    assert(i != _tree.end() && !(value < i->first));
+    _tree.erase(i);
+  }
+
+  void clear() {
+    _tree.clear();
+  }
+
+  /**
+  @brief Elemento di rango rank (0 = minimo)
+  **/
+  T at_rank(size_type rank) const {
+    return _tree.find_by_order(rank)->first;
+  }
+
+private:
+  typedef std::pair<T, unsigned long> key;
+  typedef __gnu_pbds::tree<key, __gnu_pbds::null_type, std::less<key>, __gnu_pbds::rb_tree_tag,
+                           __gnu_pbds::tree_order_statistics_node_update> tree_type;
+
+  tree_type _tree; ///< Elementi della finestra ordinati per (valore, sequenza)
+  unsigned long _seq; ///< Numero di sequenza del prossimo inserimento
+};
+
+#else
+
+template <typename T>
+using exact_quantiles = treap_quantiles<T>;
+
+#endif
+
+/**
+Politica dei quantili approssimata (DDSketch): i valori cadono per modulo
+in secchi logaritmici (gamma^(i-1), gamma^i] con gamma = (1 + alpha) / (1 - alpha),
+quindi il quantile restituito ha errore relativo al più alpha. Come in
+DDSketch i valori negativi hanno secchi propri (sul modulo) e gli zeri un
+contatore a parte. I conteggi dei secchi stanno in alberi di Fenwick:
+inserimento, rimozione e quantile costano O(log B), con B secchi
+indipendente dalla dimensione della finestra.
+I moduli sotto min_value finiscono nel primo secchio, quelli sopra
+max_value nell'ultimo.
+**/
+template <typename T>
+class ddsketch_quantiles {
+public:
+  typedef unsigned int size_type;
+
+  /**
+  @brief Costruttore
+  @param size dimensione della finestra (non usata: lo spazio dipende solo dai secchi)
+  @param alpha errore relativo massimo
+  @param min_value più piccolo modulo distinto con precisione alpha
+  @param max_value più grande modulo distinto con precisione alpha
+  **/
+  explicit ddsketch_quantiles(size_type size = 0, double alpha = 0.01,
+                              double min_value = 1e-3, double max_value = 1e9)
+  : _gamma((1 + alpha) / (1 - alpha)), _log_gamma(std::log(_gamma)),
+    _offset(static_cast<int>(std::ceil(std::log(min_value) / _log_gamma))),
+    _negatives(0), _zeros(0) {
+    (void)size;
+    int last = static_cast<int>(std::ceil(std::log(max_value) / _log_gamma));
+    _positive.assign(static_cast<std::size_t>(last - _offset + 2), 0);
+    _negative.assign(_positive.size(), 0);
+  }
+
+  void insert(const T &value) {
+    add(value, 1);
+  }
+
+  void erase(const T &value) {
+    add(value, -1);
+  }
+
+  void clear() {
+    std::fill(_positive.begin(), _positive.end(), 0);
+    std::fill(_negative.begin(), _negative.end(), 0);
+    _negatives = 0;
+    _zeros = 0;
+  }
+
+  /**
+  @brief Valore rappresentativo del secchio che contiene il rango rank
+  **/
+  T at_rank(size_type rank) const {
+    long rest = static_cast<long>(rank);
+    if(rest < _negatives)   // in ordine crescente i negativi hanno modulo decrescente
+      return static_cast<T>(-representative(find(_negative, _negatives - 1 - rest)));
+    rest -= _negatives;
+    if(rest < _zeros)
+      return static_cast<T>(0);
+    return static_cast<T>(representative(find(_positive, rest - _zeros)));
+  }
+
+private:
+  void add(const T &value, long delta) {
+    double x = static_cast<double>(value);
+    if(x > 0)
+      update(_positive, bucket(x), delta);
+    else if(x < 0) {
+      update(_negative, bucket(-x), delta);
+      _negatives += delta;
+    }
+    else
+      _zeros += delta;
+  }
+
+  // Secchio (1-based per l'albero di Fenwick) di un modulo positivo
+  std::size_t bucket(double x) const {
+    int i = static_cast<int>(std::ceil(std::log(x) / _log_gamma)) - _offset;
+    i = std::max(0, std::min(i, static_cast<int>(_positive.size()) - 2));
+    return static_cast<std::size_t>(i) + 1;
+  }
+
+  static void update(std::vector<long> &tree, std::size_t i, long delta) {
+    for(; i < tree.size(); i += i & (0 - i))
+      tree[i] += delta;
+  }
+
+  // Indice logaritmico del secchio che contiene il rango rank dell'albero
+  int find(const std::vector<long> &tree, long rank) const {
+    // discesa sull'albero di Fenwick: ultimo nodo con somma prefissa <= rank
+    std::size_t pos = 0, step = 1;
+    while(step * 2 < tree.size())
+      step *= 2;
+    for(; step != 0; step /= 2)
+      if(pos + step < tree.size() && tree[pos + step] <= rank) {
+        pos += step;
+        rank -= tree[pos];
+      }
+    return static_cast<int>(pos) + _offset;   // pos è l'indice 0-based del secchio
+  }
+
+  double representative(int i) const {
+    return 2 * std::pow(_gamma, i) / (_gamma + 1);
+  }
+
+  double _gamma; ///< Rapporto tra gli estremi di un secchio
+  double _log_gamma; ///< log(_gamma)
+  int _offset; ///< Indice logaritmico del primo secchio
+  std::vector<long> _positive; ///< Albero di Fenwick dei conteggi dei positivi (indice 0 inutilizzato)
+  std::vector<long> _negative; ///< Albero di Fenwick dei conteggi dei negativi, per modulo
+  long _negatives; ///< Numero di valori negativi
+  long _zeros; ///< Numero di zeri
+};
+
+/**
+Finestra scorrevole su cbuffer con quantili (p50, p95, p99...) sempre
+aggiornati: ogni enqueue, sovrascrittura del più vecchio e pop aggiorna
+anche la politica dei quantili, quindi una query non copia né ordina la
+finestra. Il quantile q è l'elemento di rango floor(q * (countelem() - 1)).
+L'accesso agli elementi è in sola lettura.
+@tparam Policy exact_quantiles<T> o treap_quantiles<T> (esatti) o ddsketch_quantiles<T> (errore relativo limitato)
+**/
+template <typename T, typename Policy = exact_quantiles<T>, typename Storage = heap_storage<T> >
+class quantile_cbuffer {
+public:
+  typedef unsigned int size_type;
+  typedef T value_type;
+  typedef cbuffer<T, Storage> buffer_type;
+  typedef Policy policy_type;
+
+  /**
+  @brief Costruttore
+  @param size dimensione della finestra
+  **/
+  explicit quantile_cbuffer(size_type size) : _cb(size), _policy(size) {
+  }
+
+  /**
+  @brief Costruttore con una politica già configurata (es. alpha di ddsketch_quantiles)
+  @param size dimensione della finestra
+  @param policy politica dei quantili (vuota)
+  **/
+  quantile_cbuffer(size_type size, const Policy &policy) : _cb(size), _policy(policy) {
+  }
+
+  size_type capacity() const {
+    return _cb.capacity();
+  }
+
+  size_type countelem() const {
+    return _cb.countelem();
+  }
+
+  bool isEmpty() const {
+    return _cb.isEmpty();
+  }
+
+  bool isFull() const {
+    return _cb.isFull();
+  }
+
+  const buffer_type &buffer() const {
+    return _cb;
+  }
+
+  const T &operator[](size_type index) const {
+    return _cb[index];
+  }
+
+  /**
+  @brief Accoda un valore; se la finestra è piena il più vecchio esce
+  @param value valore da accodare
+  @return true
+  **/
+  bool enqueue(const T &value) {
+    if(_cb.isFull())
+      _policy.erase(_cb[0]);
+    _cb.enqueue(value);
+    _policy.insert(value);
+    return true;
+  }
+
+  /**
+  @brief Toglie l'elemento più vecchio
+  **/
+  void pop() {
+    assert(!_cb.isEmpty());
+    _policy.erase(_cb[0]);
+    _cb.pop();
+  }
+
+  void clear() {
+    _cb.clear();
+    _policy.clear();
+  }
+
+  /**
+  @brief Quantile q della finestra
+  @pre la finestra non è vuota
+  @param q quantile in [0, 1] (0.5 = mediana, 0.99 = p99)
+  **/
+  T quantile(double q) const {
+    assert(!_cb.isEmpty());
+    q = std::max(0.0, std::min(q, 1.0));
+    return _policy.at_rank(static_cast<size_type>(q * (_cb.countelem() - 1)));
+  }
+
+  T median() const {
+    return quantile(0.5);
+  }
+
+  const Policy &policy() const {
+    return _policy;
+  }
+
+private:
+  buffer_type _cb; ///< Elementi della finestra
+  Policy _policy; ///< Struttura d'ordine sincronizzata con _cb
+};
+
+#endif
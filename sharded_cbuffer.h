@@ -0,0 +1,258 @@
+#ifndef SHARDED_CBUFF_H
+#define SHARDED_CBUFF_H
+
+#include "spsc_cbuffer.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+/**
+@file sharded_cbuffer.h
+@brief Dichiarazione della classe sharded_cbuffer e delle sorgenti di marca temporale
+**/
+
+/**
+Elemento con la sua marca (tempo o numero di sequenza) assegnata alla scrittura
+**/
+template <typename T>
+struct stamped {
+  std::uint64_t stamp;
+  T value;
+
+  stamped() : stamp(0), value() {
+  }
+
+  template <typename... Args>
+  explicit stamped(std::uint64_t s, Args&&... args) : stamp(s), value(std::forward<Args>(args)...) {
+  }
+};
+
+/**
+Marca temporale: nanosecondi di steady_clock. Non richiede sincronizzazione
+tra gli scrittori; eventi di thread diversi nello stesso nanosecondo vengono
+ordinati per indice di shard.
+**/
+struct steady_stamp {
+  static std::uint64_t now() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+};
+
+/**
+Numero di sequenza globale: ordine totale esatto, al prezzo di un
+fetch_add su un contatore condiviso da tutti gli scrittori
+**/
+struct sequence_stamp {
+  static std::uint64_t now() {
+    return counter.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static inline std::atomic<std::uint64_t> counter{0};
+};
+
+/**
+Collezione di buffer circolari, uno per thread scrittore: ogni scrittore
+ottiene con attach() uno shard tutto suo (uno spsc_cbuffer) e vi scrive
+senza lock e senza contesa con gli altri scrittori; ogni elemento riceve
+una marca da Clock. Quando lo shard è pieno l'elemento viene scartato e
+contato (lo scrittore non si blocca mai). Lo shard torna libero quando il
+writer viene distrutto o con writer::release(), e un altro thread può
+riaverlo con attach() insieme agli elementi non ancora letti.
+Il lettore con drain_ordered() toglie da tutti gli shard gli elementi
+presenti e li fonde in ordine di marca (fusione a k vie con una coda di
+priorità): gli elementi restituiti non restano nel sharded_cbuffer.
+L'ordine è globale all'interno di una chiamata; un elemento marcato mentre
+drain_ordered leggeva gli shard può comparire nella chiamata successiva con
+una marca di poco precedente all'ultima già restituita.
+I writer vanno distrutti prima del sharded_cbuffer.
+@tparam Clock sorgente delle marche (steady_stamp o sequence_stamp)
+**/
+template <typename T, typename Clock = steady_stamp>
+class sharded_cbuffer {
+  struct shard {
+    explicit shard(unsigned int size) : ring(size), dropped(0), attached(false) {
+    }
+
+    spsc_cbuffer<stamped<T> > ring; ///< Elementi dello scrittore
+    alignas(cbuffer_cache_line) std::atomic<unsigned long long> dropped; ///< Scartati a shard pieno
+    std::atomic<bool> attached; ///< Shard assegnato a un writer
+  };
+
+public:
+  typedef unsigned int size_type;
+  typedef T value_type;
+  typedef stamped<T> element_type;
+
+  /**
+  Maniglia di uno scrittore: va usata da un solo thread alla volta.
+  Si può spostare ma non copiare; alla distruzione lo shard torna libero.
+  **/
+  class writer {
+  public:
+    writer() : _shard(0) {
+    }
+
+    writer(writer &&other) noexcept : _shard(other._shard) {
+      other._shard = 0;
+    }
+
+    writer &operator=(writer &&other) noexcept {
+      if(this != &other) {
+        release();
+        _shard = other._shard;
+        other._shard = 0;
+      }
+      return *this;
+    }
+
+    ~writer() {
+      release();
+    }
+
+    /**
+    @brief Restituisce lo shard: il writer non è più utilizzabile
+    Gli elementi già scritti restano nello shard per il lettore.
+    **/
+    void release() {
+      if(_shard != 0) {
+        _shard->attached.store(false, std::memory_order_release);
+        _shard = 0;
+      }
+    }
+
+    /**
+    @brief Costruisce un elemento marcato nello shard dello scrittore
+    @param args argomenti per il costruttore di T
+    @return false se lo shard è pieno (l'elemento viene scartato)
+    **/
+    template <typename... Args>
+    bool record(Args&&... args) {
+      assert(_shard != 0);
+      if(_shard->ring.try_emplace(Clock::now(), std::forward<Args>(args)...))
+        return true;
+      _shard->dropped.store(_shard->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+  private:
+    friend class sharded_cbuffer;
+
+    writer(const writer &);
+    writer &operator=(const writer &);
+
+    explicit writer(shard *s) : _shard(s) {
+    }
+
+    shard *_shard; ///< Shard assegnato
+  };
+
+  /**
+  @brief Costruttore
+  @param shards numero massimo di scrittori
+  @param shard_size celle per shard (arrotondate alla potenza di 2)
+  **/
+  sharded_cbuffer(size_type shards, size_type shard_size) {
+    _shards.reserve(shards);
+    for(size_type i = 0; i < shards; ++i)
+      _shards.push_back(std::unique_ptr<shard>(new shard(shard_size)));
+    _staged.resize(shards);
+    _cursor.resize(shards);
+  }
+
+  size_type shards() const {
+    return static_cast<size_type>(_shards.size());
+  }
+
+  size_type shard_capacity() const {
+    return _shards.empty() ? 0 : _shards[0]->ring.capacity();
+  }
+
+  /**
+  @brief Assegna uno shard libero al thread chiamante
+  L'acquire sul flag dello shard ordina le scritture del nuovo writer dopo
+  quelle del precedente, che lo ha rilasciato con una release.
+  @throw std::runtime_error se tutti gli shard sono già assegnati
+  **/
+  writer attach() {
+    for(size_type i = 0; i < _shards.size(); ++i) {
+      bool libero = false;
+      if(_shards[i]->attached.compare_exchange_strong(libero, true, std::memory_order_acquire, std::memory_order_relaxed))
+        return writer(_shards[i].get());
+    }
+    throw std::runtime_error("sharded_cbuffer: nessuno shard libero");
+  }
+
+  /**
+  @brief Numero di elementi presenti in tutti gli shard (istantanea)
+  **/
+  size_type countelem() const {
+    size_type n = 0;
+    for(std::size_t i = 0; i < _shards.size(); ++i)
+      n += _shards[i]->ring.countelem();
+    return n;
+  }
+
+  /**
+  @brief Elementi scartati perché lo shard era pieno, sommati su tutti gli shard
+  **/
+  unsigned long long drops() const {
+    unsigned long long n = 0;
+    for(std::size_t i = 0; i < _shards.size(); ++i)
+      n += _shards[i]->dropped.load(std::memory_order_relaxed);
+    return n;
+  }
+
+  /**
+  @brief Toglie gli elementi presenti in tutti gli shard e li accoda a out
+  in ordine di marca (a parità di marca, in ordine di shard)
+  Gli elementi accodati a out vengono rimossi dagli shard.
+  Gli scrittori non vengono mai bloccati; più lettori si alternano su un mutex.
+  @param out vettore a cui accodare gli elementi
+  @return numero di elementi accodati
+  **/
+  size_type drain_ordered(std::vector<element_type> &out) {
+    std::lock_guard<std::mutex> lock(_reader);
+    typedef std::pair<std::uint64_t, size_type> head;   // (marca, shard)
+    std::priority_queue<head, std::vector<head>, std::greater<head> > heads;
+    size_type total = 0;
+    for(size_type i = 0; i < _shards.size(); ++i) {
+      std::vector<element_type> &s = _staged[i];
+      s.resize(_shards[i]->ring.countelem());
+      s.resize(s.empty() ? 0 : _shards[i]->ring.try_dequeue_n(&s[0], static_cast<size_type>(s.size())));
+      _cursor[i] = 0;
+      total += static_cast<size_type>(s.size());
+      if(!s.empty())
+        heads.push(head(s[0].stamp, i));
+    }
+    out.reserve(out.size() + total);
+    while(!heads.empty()) {
+      size_type i = heads.top().second;
+      heads.pop();
+      std::vector<element_type> &s = _staged[i];
+      out.push_back(std::move(s[_cursor[i]]));
+      if(++_cursor[i] < s.size())
+        heads.push(head(s[_cursor[i]].stamp, i));
+    }
+    return total;
+  }
+
+private:
+  sharded_cbuffer(const sharded_cbuffer &);
+  sharded_cbuffer &operator=(const sharded_cbuffer &);
+
+  std::vector<std::unique_ptr<shard> > _shards; ///< Uno shard per scrittore
+  std::mutex _reader; ///< Serializza i lettori (gli scrittori non lo toccano)
+  std::vector<std::vector<element_type> > _staged; ///< Elementi tolti da ciascuno shard (riusati tra le chiamate)
+  std::vector<std::size_t> _cursor; ///< Prossimo elemento da fondere per ciascuno shard
+};
+
+#endif
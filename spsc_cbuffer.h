@@ -0,0 +1,236 @@
+#ifndef SPSC_CBUFF_H
+#define SPSC_CBUFF_H
+
+#include "cbuffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+/**
+@file spsc_cbuffer.h
+@brief Dichiarazione della classe spsc_cbuffer
+**/
+
+/**
+Dimensione della linea di cache usata per separare gli indici del produttore
+e del consumatore (evita il false sharing)
+**/
+static const std::size_t cbuffer_cache_line = 64;
+
+/**
+Buffer circolare lock-free per un solo produttore e un solo consumatore.
+Usa le stesse politiche di memorizzazione di cbuffer. Testa e coda sono
+contatori che crescono senza limiti (la cella si ottiene con Storage::mod)
+e stanno su linee di cache diverse; ogni lato tiene una copia locale
+dell'indice dell'altro e rilegge quello atomico solo quando la copia
+non basta.
+A differenza di cbuffer, quando il buffer è pieno try_enqueue fallisce:
+il produttore non può sovrascrivere celle possedute dal consumatore.
+@tparam Storage politica di memorizzazione (pow2_storage: cella con una maschera)
+**/
+template <typename T, typename Storage = pow2_storage<T> >
+class spsc_cbuffer {
+public:
+  typedef unsigned int size_type;
+  typedef T value_type;
+  typedef Storage storage_type;
+
+  /**
+  @brief Costruttore
+  @param size numero di celle richieste (arrotondato secondo la politica)
+  **/
+  explicit spsc_cbuffer(size_type size)
+  : _storage(size), _tail(0), _cached_head(0), _head(0), _cached_tail(0) {
+  }
+
+  /**
+  @brief Distruttore. Distrugge gli elementi non ancora consumati.
+  **/
+  ~spsc_cbuffer() {
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+      std::size_t h = _head.load(std::memory_order_relaxed);
+      std::size_t t = _tail.load(std::memory_order_relaxed);
+      for(; h != t; ++h)
+        _storage.data()[_storage.mod(h)].~T();
+    }
+  }
+
+  size_type capacity() const {
+    return _storage.capacity();
+  }
+
+  /**
+  @brief Numero di elementi presenti (istantanea, può essere già superata)
+  **/
+  size_type countelem() const {
+    std::size_t t = _tail.load(std::memory_order_acquire);
+    std::size_t h = _head.load(std::memory_order_acquire);
+    return static_cast<size_type>(t - h);
+  }
+
+  bool isEmpty() const {
+    return countelem() == 0;
+  }
+
+  /**
+  @brief Accoda un valore (solo thread produttore)
+  @param value valore da accodare
+  @return false se il buffer è pieno
+  **/
+  bool try_enqueue(const T &value) {
+    return try_emplace(value);
+  }
+
+  bool try_enqueue(T &&value) {
+    return try_emplace(std::move(value));
+  }
+
+  /**
+  @brief Costruisce un elemento in coda (solo thread produttore)
+  @param args argomenti per il costruttore di T
+  @return false se il buffer è pieno
+  **/
+  template <typename... Args>
+  bool try_emplace(Args&&... args) {
+    std::size_t t = _tail.load(std::memory_order_relaxed);
+    if(t - _cached_head == capacity()) {
+      _cached_head = _head.load(std::memory_order_acquire);
+      if(t - _cached_head == capacity())
+        return false;
+    }
+    ::new (static_cast<void*>(_storage.data() + _storage.mod(t))) T(std::forward<Args>(args)...);
+    _tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+  @brief Toglie la testa spostandola in out (solo thread consumatore)
+  @param out destinazione del valore
+  @return false se il buffer è vuoto
+  **/
+  bool try_dequeue(T &out) {
+    std::size_t h = _head.load(std::memory_order_relaxed);
+    if(h == _cached_tail) {
+      _cached_tail = _tail.load(std::memory_order_acquire);
+      if(h == _cached_tail)
+        return false;
+    }
+    T *cell = _storage.data() + _storage.mod(h);
+    out = std::move(*cell);
+    cell->~T();
+    _head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+  @brief Accoda fino a n valori con una sola pubblicazione della coda
+  I valori sono scritti in al più due tratti contigui (memcpy se T è
+  banalmente copiabile). Se una copia lancia, i valori già costruiti
+  vengono distrutti e nulla viene pubblicato.
+  @param src indirizzo del primo valore
+  @param n numero di valori da accodare
+  @return numero di valori accodati (minore di n se non c'è spazio)
+  **/
+  size_type try_enqueue_n(const T *src, size_type n) {
+    std::size_t t = _tail.load(std::memory_order_relaxed);
+    size_type free = capacity() - static_cast<size_type>(t - _cached_head);
+    if(free < n) {
+      _cached_head = _head.load(std::memory_order_acquire);
+      free = capacity() - static_cast<size_type>(t - _cached_head);
+    }
+    size_type m = std::min(n, free);
+    size_type pos = _storage.mod(t);
+    size_type n1 = std::min(m, capacity() - pos);
+    copy_in(_storage.data() + pos, src, n1);
+    try {
+      copy_in(_storage.data(), src + n1, m - n1);
+    }
+    catch(...) {
+      destroy(_storage.data() + pos, n1);
+      throw;
+    }
+    _tail.store(t + m, std::memory_order_release);
+    return m;
+  }
+
+  /**
+  @brief Toglie fino a n valori con una sola pubblicazione della testa
+  @param out array di destinazione (almeno n elementi già costruiti)
+  @param n numero massimo di valori da togliere
+  @return numero di valori tolti
+  **/
+  size_type try_dequeue_n(T *out, size_type n) {
+    std::size_t h = _head.load(std::memory_order_relaxed);
+    size_type avail = static_cast<size_type>(_cached_tail - h);
+    if(avail < n) {
+      _cached_tail = _tail.load(std::memory_order_acquire);
+      avail = static_cast<size_type>(_cached_tail - h);
+    }
+    size_type m = std::min(n, avail);
+    size_type pos = _storage.mod(h);
+    size_type n1 = std::min(m, capacity() - pos);
+    move_out(out, _storage.data() + pos, n1);
+    move_out(out + n1, _storage.data(), m - n1);
+    _head.store(h + m, std::memory_order_release);
+    return m;
+  }
+
+private:
+  spsc_cbuffer(const spsc_cbuffer &);
+  spsc_cbuffer &operator=(const spsc_cbuffer &);
+
+  // Costruisce n elementi in dst copiandoli da src; se una copia lancia
+  // distrugge quelli già costruiti
+  static void copy_in(T *dst, const T *src, size_type n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      if(n != 0)
+        std::memcpy(static_cast<void*>(dst), src, n * sizeof(T));
+    }
+    else {
+      size_type i = 0;
+      try {
+        for(; i < n; ++i)
+          ::new (static_cast<void*>(dst + i)) T(src[i]);
+      }
+      catch(...) {
+        destroy(dst, i);
+        throw;
+      }
+    }
+  }
+
+  // Distrugge n elementi a partire da p
+  static void destroy(T *p, size_type n) {
+    if constexpr (!std::is_trivially_destructible<T>::value)
+      for(size_type i = 0; i < n; ++i)
+        p[i].~T();
+  }
+
+  // Sposta n elementi da src in out e li distrugge
+  static void move_out(T *out, T *src, size_type n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      if(n != 0)
+        std::memcpy(out, src, n * sizeof(T));
+    }
+    else {
+      for(size_type i = 0; i < n; ++i) {
+        out[i] = std::move(src[i]);
+        src[i].~T();
+      }
+    }
+  }
+
+  Storage _storage; ///< Celle e aritmetica degli indici (in sola lettura dopo la costruzione)
+
+  alignas(cbuffer_cache_line) std::atomic<std::size_t> _tail; ///< Prossima cella da scrivere (produttore)
+  std::size_t _cached_head; ///< Copia della testa vista dal produttore
+
+  alignas(cbuffer_cache_line) std::atomic<std::size_t> _head; ///< Prossima cella da leggere (consumatore)
+  std::size_t _cached_tail; ///< Copia della coda vista dal consumatore
+  // l'allineamento dei membri porta la dimensione della classe a un multiplo
+  // della linea di cache: dopo _cached_tail non serve altro riempimento
+};
+
+#endif
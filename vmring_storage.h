@@ -0,0 +1,156 @@
+#ifndef VMRING_STORAGE_H
+#define VMRING_STORAGE_H
+
+#include "cbuffer.h"
+
+#include <cstddef>
+#include <type_traits>
+#include <sys/mman.h> // memfd_create, mmap
+#include <unistd.h>   // ftruncate, close, sysconf
+/**
+@file vmring_storage.h
+@brief Politica di memorizzazione vmring_storage (Linux)
+**/
+
+/**
+Politica di memorizzazione "anello in memoria virtuale": le pagine di un
+memfd vengono mappate due volte di seguito, quindi la cella capacity() + i
+è la stessa cella i. Da data() + first si possono leggere countelem()
+elementi contigui senza mai gestire il giro (vedi cbuffer::linearize).
+Richiede che capacity() * sizeof(T) sia un multiplo della dimensione di
+pagina (round_capacity calcola la capacità adatta più vicina); in caso
+contrario, o se la mappatura fallisce, si ricade su un normale array sullo
+heap e mirrored() ritorna false.
+Le due viste sono alias della stessa memoria, per questo T deve essere
+banalmente copiabile.
+**/
+template <typename T>
+class vmring_storage {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "vmring_storage richiede T banalmente copiabile");
+
+public:
+  typedef unsigned int size_type;
+
+  vmring_storage() : _data(0), _capacity(0), _mirrored(false) {
+  }
+
+  explicit vmring_storage(size_type size) : _data(0), _capacity(0), _mirrored(false) {
+    std::size_t bytes = static_cast<std::size_t>(size) * sizeof(T);
+    if(bytes != 0 && bytes % page_size() == 0)
+      _data = map_twice(bytes);
+    if(_data != 0)
+      _mirrored = true;
+    else
+      _data = cbuffer_detail::allocate_raw<T>(size);
+    _capacity = size;
+  }
+
+  ~vmring_storage() {
+    if(_mirrored)
+      ::munmap(_data, 2 * static_cast<std::size_t>(_capacity) * sizeof(T));
+    else
+      cbuffer_detail::deallocate_raw(_data);
+  }
+
+  T *data() {
+    return _data;
+  }
+
+  const T *data() const {
+    return _data;
+  }
+
+  size_type capacity() const {
+    return _capacity;
+  }
+
+  /**
+  @brief Ritorna se l'array è seguito dalla sua seconda mappatura
+  **/
+  bool mirrored() const {
+    return _mirrored;
+  }
+
+  /**
+  @brief Riporta un indice nel range [0, capacity) (come heap_storage)
+  @pre i < 2 * capacity
+  **/
+  size_type wrap(size_type i) const {
+    return i >= _capacity ? i - _capacity : i;
+  }
+
+  /**
+  @brief Cella corrispondente a un contatore che cresce senza limiti
+  **/
+  size_type mod(std::size_t seq) const {
+    return static_cast<size_type>(seq % _capacity);
+  }
+
+  // Lo stato degli indici vive solo in cbuffer (vedi mmap_storage)
+  static void load_state(size_type &f, size_type &n) {
+    f = 0;
+    n = 0;
+  }
+
+  static void store_state(size_type, size_type) {
+  }
+
+  static const bool pointer_swap = true; ///< swap scambia solo i puntatori
+  static const bool growable = true; ///< cbuffer può sostituire l'array con uno di capacità diversa
+
+  void swap(vmring_storage &other) {
+    std::swap(_data, other._data);
+    std::swap(_capacity, other._capacity);
+    std::swap(_mirrored, other._mirrored);
+  }
+
+  /**
+  @brief Capacità minima >= n per cui l'array può essere mappato due volte
+  @param n numero di celle richieste
+  @return numero di celle multiplo della dimensione di pagina in byte
+  **/
+  static size_type round_capacity(size_type n) {
+    std::size_t page = page_size();
+    std::size_t step = 1;
+    while((step * sizeof(T)) % page != 0)
+      ++step;
+    return static_cast<size_type>((n + step - 1) / step * step);
+  }
+
+  static std::size_t page_size() {
+    return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  }
+
+private:
+  vmring_storage(const vmring_storage &);
+  vmring_storage &operator=(const vmring_storage &);
+
+  // Riserva 2 * bytes di indirizzi e vi mappa due volte lo stesso memfd.
+  // Ritorna 0 se una delle chiamate di sistema fallisce.
+  static T *map_twice(std::size_t bytes) {
+    int fd = ::memfd_create("cbuffer", MFD_CLOEXEC);
+    if(fd < 0)
+      return 0;
+    void *base = MAP_FAILED;
+    if(::ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+      base = ::mmap(0, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base != MAP_FAILED) {
+      char *p = static_cast<char*>(base);
+      void *lo = ::mmap(p, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+      void *hi = ::mmap(p + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+      if(lo == MAP_FAILED || hi == MAP_FAILED) {
+        ::munmap(base, 2 * bytes);
+        base = MAP_FAILED;
+      }
+    }
+    ::close(fd);
+    return base == MAP_FAILED ? 0 : static_cast<T*>(base);
+  }
+
+  T *_data; ///< Inizio della prima mappatura (o dell'array sullo heap)
+  size_type _capacity; ///< Numero di celle
+  bool _mirrored; ///< true se _data + _capacity è la seconda mappatura
+};
+
+#endif